@@ -0,0 +1,90 @@
+#ifndef FILTER_EXPR_HH
+#define FILTER_EXPR_HH
+
+#include "trace_store.hh"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * 过滤表达式求值时的记录上下文
+ * 记录由数据块中的下标表示，只设置当前记录相关的下标，其余为 kNone
+ */
+struct FilterRecord {
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  const TraceStore *store = nullptr;
+  const TraceBlock *block = nullptr;
+  uint32_t inst = kNone;   // TraceBlock 中的指令下标
+  uint32_t stage = kNone;  // TraceBlock 中的 stage 下标
+  uint32_t func = kNone;
+  uint32_t cnt = kNone;
+};
+
+/**
+ * FilterExpr 类：视图的 "where" 过滤表达式
+ *
+ * 语法：
+ *   expr       := and ('||' and)*
+ *   and        := unary ('&&' unary)*
+ *   unary      := '!' unary | '(' expr ')' | 'true' | 'false' | comparison
+ *   comparison := operand op operand | field 'in' '[' literal (',' literal)* ']'
+ *   op         := '==' | '!=' | '~' | '!~' | '<' | '<=' | '>' | '>='
+ *   operand    := field | "字符串" | 数字
+ *
+ * 字段：device, thread, inst.name, inst.seq, stage.name, stage.title, stage.start,
+ *       stage.end, stage.duration, func.name, func.start, func.end, func.duration,
+ *       cnt.name, cnt.unit, meta.<key>, inst.meta.<key>, stage.meta.<key>
+ *   - meta.<key> 先查 stage 的 metadata，再查 instruction；函数和计数器查各自的 metadata
+ *   - key 含特殊字符时可写成 meta["key"]
+ *   - '~' 为子串匹配，与 *_filter 数组的语义相同
+ *   - 当前记录没有该字段（如 cnt 视图中的 thread、不存在的 metadata）时，比较结果为 false
+ *
+ * 表达式在 parseShowJson 中编译一次为谓词树：常量比较会被折叠，
+ * &&/|| 的子节点按求值代价排序，便宜的条件先求值以尽早短路。
+ *
+ * 对名称字段和 metadata 值的比较结果按驻留 ID 缓存，metadata 键在首次求值时解析为驻留 ID，
+ * 缓存不加锁，同一个表达式不能被多个线程同时求值。
+ */
+class FilterExpr {
+public:
+  FilterExpr();
+  ~FilterExpr();
+
+  /**
+   * 编译表达式
+   * @param text 表达式文本
+   * @param error 编译失败时输出错误信息
+   * @return 是否编译成功
+   */
+  bool compile(const std::string &text, std::string &error);
+
+  /**
+   * 是否配置了表达式（未配置时所有记录都通过）
+   */
+  bool enabled() const { return root_ != nullptr; }
+
+  /**
+   * 表达式是否引用了 stage 级别的字段（需要对每个 stage 单独求值）
+   */
+  bool usesStage() const { return uses_stage_; }
+
+  /**
+   * 对记录求值
+   */
+  bool eval(const FilterRecord &record) const;
+
+  /**
+   * 编译后谓词树的文本形式（折叠、排序之后），用于日志输出
+   */
+  std::string describe() const;
+
+  struct Node;
+
+private:
+  std::shared_ptr<const Node> root_;  // 视图配置拷贝时共享同一棵谓词树
+  bool uses_stage_;
+};
+
+#endif // FILTER_EXPR_HH
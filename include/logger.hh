@@ -0,0 +1,114 @@
+#ifndef LOGGER_HH
+#define LOGGER_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 日志级别，数值越大越详细
+ */
+enum class LogLevel : int {
+  kError = 0,
+  kWarn = 1,
+  kInfo = 2,
+  kDebug = 3,  // 每个数据块 / 每个视图的细节
+  kTrace = 4,  // 每个事件、每条 track，只用于排查问题
+};
+
+/**
+ * Logger 类：带级别的异步日志
+ *
+ * 调用线程只把格式化好的日志追加到内存缓冲，由后台线程批量写入 std::cout（error/warn 写入 std::cerr），
+ * 避免热路径上每条日志都 std::endl 刷新。缓冲超过上限时调用线程会等待后台线程写出，内存不会无限增长。
+ *
+ * 请通过 LOG_ERROR / LOG_WARN / LOG_INFO / LOG_DEBUG / LOG_TRACE 宏使用：
+ * 级别未开启时不会对参数求值；定义 NDEBUG（Release 构建）时 LOG_DEBUG / LOG_TRACE 直接编译为空。
+ */
+class Logger {
+public:
+  static Logger &instance();
+
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  /**
+   * 设置运行时日志级别（默认 kInfo）
+   */
+  void setLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+  bool enabled(LogLevel level) const {
+    return static_cast<int>(level) <= level_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * 提交一条日志（不含换行）
+   */
+  void write(LogLevel level, const std::string &message);
+
+  /**
+   * 阻塞直到已提交的日志全部写出并刷新到输出流
+   * 重定向或恢复 std::cout / std::cerr 之前必须调用
+   */
+  void flush();
+
+  /**
+   * 解析级别名称：error / warn / info / debug / trace
+   * @return 名称是否合法
+   */
+  static bool parseLevel(const std::string &text, LogLevel &level);
+
+private:
+  Logger();
+  ~Logger();
+
+  // 连续写入同一个输出流的日志合并为一段
+  struct Chunk {
+    bool to_stderr;
+    std::string text;
+  };
+
+  void workerLoop();
+
+  static constexpr size_t kMaxPendingBytes = 16 << 20;
+
+  std::atomic<int> level_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;   // 有新日志或需要退出
+  std::condition_variable space_cv_;  // 缓冲有空闲或已全部写出
+  std::vector<Chunk> pending_;
+  size_t pending_bytes_;
+  uint64_t submitted_;                // 已提交的日志条数
+  uint64_t written_;                  // 已写出的日志条数
+  bool stop_;
+  std::thread worker_;
+};
+
+#define PERF_LOG(level, expr)                                  \
+  do {                                                         \
+    if (Logger::instance().enabled(level)) {                   \
+      std::ostringstream perf_log_stream;                      \
+      perf_log_stream << expr;                                 \
+      Logger::instance().write(level, perf_log_stream.str());  \
+    }                                                          \
+  } while (0)
+
+#define LOG_ERROR(expr) PERF_LOG(LogLevel::kError, expr)
+#define LOG_WARN(expr) PERF_LOG(LogLevel::kWarn, expr)
+#define LOG_INFO(expr) PERF_LOG(LogLevel::kInfo, expr)
+
+#ifdef NDEBUG
+#define LOG_DEBUG(expr) do { } while (0)
+#define LOG_TRACE(expr) do { } while (0)
+#else
+#define LOG_DEBUG(expr) PERF_LOG(LogLevel::kDebug, expr)
+#define LOG_TRACE(expr) PERF_LOG(LogLevel::kTrace, expr)
+#endif
+
+#endif // LOGGER_HH
@@ -0,0 +1,169 @@
+#ifndef PERF_DATA_STREAM_HH
+#define PERF_DATA_STREAM_HH
+
+#include "unified_perf_format.pb.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+/**
+ * 分块流式文件格式（framed format）
+ *
+ * 文件布局：
+ *   [magic: 8 字节 "UPFSTRM1"] [version: fixed32 小端]
+ *   [chunk_size: varint64] [UnifiedPerfData 序列化字节] ... 直到文件结束
+ *
+ * 每个 chunk 是一个独立的 UnifiedPerfData 消息，单个 chunk 必须小于 2GB，
+ * 整个文件大小不受 protobuf 单消息 2GB 上限的限制。
+ */
+constexpr char kPerfDataStreamMagic[] = "UPFSTRM1";
+constexpr size_t kPerfDataStreamMagicSize = sizeof(kPerfDataStreamMagic) - 1;
+constexpr uint32_t kPerfDataStreamVersion = 1;
+
+/**
+ * MappedFile 类：只读内存映射文件（RAII）
+ * 映射后通过 madvise 提示内核顺序读取并尽量使用大页
+ */
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * 映射整个文件
+   * @param file_path 文件路径
+   * @return 是否映射成功（空文件、管道等无法映射的文件返回 false）
+   */
+  bool open(const std::string &file_path);
+
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  /**
+   * 通知内核 [0, offset) 区域已经解析完毕，可以从本进程的常驻内存中释放
+   * 已释放区域之后不能再访问；为减少系统调用，只有累计足够多时才真正释放
+   * @param offset 已消费的字节偏移
+   */
+  void releaseUpTo(size_t offset);
+
+private:
+  uint8_t *data_;
+  size_t size_;
+  size_t released_;  // 已释放的页对齐前缀长度
+};
+
+/**
+ * PerfDataStreamReader 类：逐块读取分块流式文件
+ * 支持两种数据源：
+ * 1. 文件路径：基于 FileInputStream/CodedInputStream，任意时刻只持有一个 chunk 的数据
+ * 2. 内存区域（通常来自 MappedFile）：通过 ArrayInputStream 直接在映射上解析，无额外拷贝
+ */
+class PerfDataStreamReader {
+public:
+  explicit PerfDataStreamReader(const std::string &file_path);
+  PerfDataStreamReader(const uint8_t *data, size_t size);
+  ~PerfDataStreamReader();
+
+  PerfDataStreamReader(const PerfDataStreamReader &) = delete;
+  PerfDataStreamReader &operator=(const PerfDataStreamReader &) = delete;
+
+  /**
+   * 打开文件并校验文件头
+   * @return 文件是分块流式格式时返回 true；文件无法打开或不是该格式时返回 false
+   */
+  bool open();
+
+  /**
+   * 读取下一个数据块
+   * @param perf_data 输出的数据块（会先被清空）
+   * @return 成功读取返回 true；到达文件末尾或出错返回 false（通过 hasError() 区分）
+   */
+  bool next(unified_perf_format::UnifiedPerfData *perf_data);
+
+  /**
+   * 是否在读取过程中出错（文件被截断、chunk 解析失败等）
+   */
+  bool hasError() const { return has_error_; }
+
+  /**
+   * 已成功读取的 chunk 数量
+   */
+  uint64_t chunkCount() const { return chunk_cnt_; }
+
+  /**
+   * 内存数据源已消费的字节偏移（文件数据源恒为 0）
+   */
+  size_t consumedBytes() const { return offset_; }
+
+private:
+  std::string file_path_;
+  int fd_;
+  std::unique_ptr<google::protobuf::io::FileInputStream> file_stream_;
+  const uint8_t *data_;  // 内存数据源，为空表示使用文件数据源
+  size_t size_;
+  size_t offset_;
+  bool has_error_;
+  uint64_t chunk_cnt_;
+
+  bool openMapped();
+  bool nextMapped(unified_perf_format::UnifiedPerfData *perf_data);
+};
+
+/**
+ * 把数据块中的名称、show_title、计数器单位和 metadata 转为字典编码：
+ * 字符串写入 string_table（已有的表会被沿用），记录中只保留 *_id 和 metadata_ids
+ * 生产端在 PerfDataStreamWriter::write 之前调用，重复的字符串在每个数据块中只存一份
+ * @param perf_data 要就地转换的数据块
+ */
+void encodeStringTable(unified_perf_format::UnifiedPerfData *perf_data);
+
+/**
+ * 把计数器的 values 转为打包编码（sample_time_deltas + sample_values / sample_values_f32）
+ * 每个采样点只占一个差值 varint 和一个定长值，没有子消息的标签和长度
+ * @param perf_data 要就地转换的数据块，已有打包采样点的计数器保持不变
+ * @param single_precision 为 true 时值以 float 存放，体积更小但会损失精度
+ */
+void packCounterSamples(unified_perf_format::UnifiedPerfData *perf_data,
+                        bool single_precision = false);
+
+/**
+ * PerfDataStreamWriter 类：写出分块流式文件，供数据生产端使用
+ */
+class PerfDataStreamWriter {
+public:
+  PerfDataStreamWriter();
+  ~PerfDataStreamWriter();
+
+  PerfDataStreamWriter(const PerfDataStreamWriter &) = delete;
+  PerfDataStreamWriter &operator=(const PerfDataStreamWriter &) = delete;
+
+  /**
+   * 创建文件并写入文件头
+   * @param file_path 输出文件路径
+   * @return 是否成功
+   */
+  bool open(const std::string &file_path);
+
+  /**
+   * 追加一个数据块
+   * @param perf_data 数据块，序列化后必须小于 2GB
+   * @return 是否成功
+   */
+  bool write(const unified_perf_format::UnifiedPerfData &perf_data);
+
+  /**
+   * 刷新缓冲并关闭文件
+   * @return 是否成功
+   */
+  bool close();
+
+private:
+  int fd_;
+  std::unique_ptr<google::protobuf::io::FileOutputStream> file_stream_;
+};
+
+#endif // PERF_DATA_STREAM_HH
@@ -1,13 +1,19 @@
 #ifndef PERF_SHOWER_HH
 #define PERF_SHOWER_HH
 
+#include "filter_expr.hh"
 #include "perfetto_wrapper.hh"
-#include "unified_perf_format.pb.h"
+#include "string_interner.hh"
+#include "trace_store.hh"
+#include "view_filters.hh"
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
 #include <unordered_map>
 
+class ThreadPool;
+
 /**
  * 过滤器规则：支持字符串匹配
  */
@@ -16,16 +22,38 @@ struct FilterRule {
   FilterRule(const std::string &v) : value(v) {}
 };
 
+/**
+ * pipe 模式的 lane 分配策略（同名 stage 重叠时分配到不同的 lane/track 上）
+ */
+enum class LanePolicy {
+  kSmallFirst,     // 选编号最小的空闲 lane
+  kLastStepFirst,  // 从上一次使用的 lane 开始循环查找空闲 lane
+};
+
 /**
  * 视图配置：对应 show.json 中的一个 view
  */
 struct ViewConfig {
-  std::string mode;  // "pipe", "line", "func", "cnt"
+  std::string mode;  // "pipe", "line", "line_packed", "func", "cnt"
   std::vector<FilterRule> timeline_filter;  // 时间范围过滤，格式: "start-end"
   std::vector<FilterRule> event_filter;     // 事件名称过滤
   std::vector<FilterRule> track_filter;     // 轨道名称过滤
   std::vector<FilterRule> device_filter;    // 设备名称过滤
   std::vector<FilterRule> thread_filter;    // 线程ID过滤
+
+  TimelineFilter timeline;                  // 由 timeline_filter 编译得到的区间集合
+  SubstringMatcher event_matcher;           // 由 event_filter 编译得到的多模式匹配器
+  SubstringMatcher track_matcher;           // 由 track_filter 编译得到的多模式匹配器
+  SubstringMatcher device_matcher;          // 由 device_filter 编译得到的多模式匹配器
+  ThreadFilter thread;                      // 由 thread_filter 编译得到的线程位图（加载 role 配置后编译）
+  FilterExpr where;                         // "where" 过滤表达式，与上面的过滤器是 AND 关系
+  bool dedup_inst_metadata = false;         // instruction 的 metadata 只附加到它的第一个 stage 上
+  LanePolicy lane_policy = LanePolicy::kSmallFirst;  // pipe / line_packed 模式的 lane 分配策略
+  uint32_t max_lanes = 0;                   // line_packed 模式的 lane 数上限，0 表示不限制
+  bool dependency_flows = true;             // 指令模式中按 parent_seq_num 画出依赖箭头
+  std::vector<std::string> metadata_keys;       // 只输出这些 metadata 键
+  std::vector<std::string> drop_metadata_keys;  // 不输出这些 metadata 键
+  MetadataKeyFilter metadata_filter;            // 由上面两个列表编译得到的键集合
 };
 
 /**
@@ -37,6 +65,80 @@ struct JsonConfig {
   std::string output;                       // 输出文件路径
   std::string kernel;                       // kernel 名称
   std::string role_path;                    // role.json 文件路径
+  int jobs = 0;                             // 并行读取文件的线程数，<= 0 表示自动
+  bool fused_views = true;                  // 是否一次遍历同时处理所有视图
+  std::string backend;                      // 追踪输出后端："sdk" 或 "stream"，为空时使用 "sdk"
+};
+
+/**
+ * 过滤后的指令视图：只保存记录在 TraceBlock 中的下标，不拷贝任何字段
+ * 每条指令通过过滤的 stage 在 stages 中连续存放，由 [stage_begin, stage_begin + stage_count) 描述
+ */
+struct FilteredInstructions {
+  struct Entry {
+    uint32_t inst;  // TraceBlock 中的指令下标
+    size_t stage_begin;
+    size_t stage_count;
+  };
+  std::vector<Entry> insts;
+  std::vector<uint32_t> stages;  // TraceBlock 中的 stage 下标
+
+  bool empty() const { return insts.empty(); }
+  void clear() { insts.clear(); stages.clear(); }
+};
+
+/**
+ * line_packed 模式中一个 device track 下的 lane 池，在数据块之间复用
+ */
+struct InstLanePool {
+  std::vector<std::shared_ptr<perfetto::NamedTrack>> tracks;  // 每个 lane 对应的 track
+  std::vector<uint64_t> lane_end;  // 每个 lane 上最后一条指令的结束时间
+};
+
+/**
+ * 过滤后的函数视图
+ */
+struct FilteredFunctions {
+  std::vector<uint32_t> functions;  // TraceBlock 中的函数下标
+
+  bool empty() const { return functions.empty(); }
+  void clear() { functions.clear(); }
+};
+
+/**
+ * 过滤后的计数器视图：通过过滤的采样点按连续区间记录，
+ * 每个计数器的区间在 ranges 中连续存放，输出时直接顺序访问采样列
+ */
+struct FilteredCounters {
+  struct Entry {
+    uint32_t cnt;  // TraceBlock 中的计数器下标
+    size_t range_begin;
+    size_t range_count;
+  };
+  struct SampleRange {
+    uint32_t begin;  // TraceBlock 中的采样点下标，左闭右开
+    uint32_t end;
+  };
+  std::vector<Entry> counters;
+  std::vector<SampleRange> ranges;
+
+  bool empty() const { return counters.empty(); }
+  size_t sampleCount() const {
+    size_t count = 0;
+    for (const auto &range : ranges) {
+      count += range.end - range.begin;
+    }
+    return count;
+  }
+  void clear() { counters.clear(); ranges.clear(); }
+};
+
+/**
+ * 视图的名称过滤结果：按驻留 ID 预先计算的通过位图
+ */
+struct NameFilterBits {
+  NameBitset event;  // event_filter
+  NameBitset track;  // track_filter
 };
 
 /**
@@ -57,9 +159,13 @@ public:
 
   /**
    * 初始化 Perfetto 追踪系统
-   * @param buf_size_kb 缓冲区大小（KB），默认 4096KB
+   * 追踪后端在 show() 读取到输出路径后才启动（流式后端需要先创建输出文件）
+   * @param buf_size_kb SDK 后端的缓冲区大小（KB），<= 0 表示使用 kDefaultBufferSizeKb。
+   *        SDK 后端在追踪过程中周期性地把缓冲区写入输出文件，缓冲区只需容纳一个写入周期的事件
    */
-  void init(int buf_size_kb = 409600);
+  void init(int buf_size_kb = 0);
+
+  static constexpr int kDefaultBufferSizeKb = 128 * 1024;
 
   /**
    * 结束追踪并保存到文件
@@ -74,42 +180,104 @@ public:
    * @return 输出文件路径（从 JSON 配置中读取）
    */
   std::string show(const std::string &show_json_path);
+
+  /**
+   * 设置并行读取文件的线程数（命令行 --jobs），优先于 show.json 中的 "jobs"
+   * @param jobs 线程数，<= 0 表示使用 show.json 配置或硬件并发数
+   */
+  void setJobs(int jobs) { jobs_ = jobs; }
+
+  /**
+   * 设置追踪输出后端（命令行 --backend），优先于 show.json 中的 "backend"
+   * @param backend "sdk" 或 "stream"，为空表示使用 show.json 配置
+   */
+  void setBackend(const std::string &backend) { backend_ = backend; }
   
 private:
   /**
    * 处理单个 Instruction 并添加到追踪
-   * @param inst Instruction 对象引用
+   * @param store 列式数据
+   * @param block 指令所在的数据块
+   * @param inst 指令在数据块中的下标
    * @param parent_track 父轨道
+   * @param dedup_inst_metadata 是否只在第一个 stage 上附加 instruction 的 metadata
+   * @param key_filter metadata 键过滤器，为空时输出所有键
    */
-  void processInstruction(const unified_perf_format::Instruction &inst,
-                          perfetto::Track &parent_track);
+  void processInstruction(const TraceStore &store, const TraceBlock &block, uint32_t inst,
+                          perfetto::Track &parent_track,
+                          bool dedup_inst_metadata = false,
+                          const MetadataKeyFilter *key_filter = nullptr);
   
   /**
-   * 处理 Pipe 模式
+   * 输出一个 stage 事件，flows 非空时附带依赖箭头
+   * @param stage stage 在数据块中的下标
+   * @param identity 附加的指令身份（line_packed 模式），其他模式为空
+   * @param inst_metadata 附加的 instruction metadata
+   * @param flows 该 stage 上出发和结束的 flow
+   * @param key_filter metadata 键过滤器，为空时输出所有键
    */
-  void processPipMode(const unified_perf_format::BatchInstruction &batch_instruction,
-                      perfetto::Track &parent_track);
+  void addStageEvent(const std::string &event_name, perfetto::NamedTrack &track,
+                     const TraceStore &store, const TraceBlock &block, uint32_t stage,
+                     const MetadataSpan &identity, const MetadataSpan &inst_metadata,
+                     const EventFlows &flows, const MetadataKeyFilter *key_filter);
+
+  /**
+   * 处理 Pipe 模式，stage 按 name 的驻留 ID 分组
+   * @param store 列式数据
+   * @param block 过滤结果所属的数据块
+   * @param filtered 过滤后的指令视图
+   * @param parent_track 父轨道
+   * @param view_config 视图配置（metadata 的去重与键过滤、lane 分配策略）
+   */
+  void processPipMode(const TraceStore &store, const TraceBlock &block,
+                      const FilteredInstructions &filtered,
+                      perfetto::Track &parent_track,
+                      const ViewConfig &view_config);
 
   /**
    * 处理 Line 模式（线性模式）
+   * @param filtered 过滤后的指令视图
+   * @param parent_track 父轨道
+   * @param view_config 视图配置（metadata 的去重与键过滤）
+   */
+  void processLineMode(const TraceStore &store, const TraceBlock &block,
+                       const FilteredInstructions &filtered,
+                       perfetto::Track &parent_track,
+                       const ViewConfig &view_config);
+
+  /**
+   * 处理 Line Packed 模式：生命周期互不重叠的指令复用同一个 lane，
+   * track 数等于同时在执行的指令数的峰值，而不是指令总数
+   * 指令的名称和 "<thread_id>_<global_seq_num>" 作为 inst_name / inst_id 附加到每个 stage 上
+   * @param filtered 过滤后的指令视图
+   * @param parent_track 父轨道
+   * @param view_config 视图配置（metadata 的去重与键过滤、lane 分配策略与上限）
+   * @param pool parent_track 下已有的 lane，新建的 lane 也加入其中
    */
-  void processLineMode(const unified_perf_format::BatchInstruction &batch_instruction,
-                       perfetto::Track &parent_track);
+  void processLinePackedMode(const TraceStore &store, const TraceBlock &block,
+                             const FilteredInstructions &filtered,
+                             perfetto::Track &parent_track,
+                             const ViewConfig &view_config,
+                             InstLanePool &pool);
 
   /**
-   * 处理 Func 模式
-   * @param batch_function 函数批次数据
+   * 处理 Func 模式，track 名称使用数据块的设备名
+   * @param filtered 过滤后的函数视图
    * @param parent_track 父轨道
-   * @param device_name 设备名称，用于创建 track 名称
+   * @param view_config 视图配置（metadata 键过滤）
    */
-  void processFuncMode(const unified_perf_format::BatchFunction &batch_function,
+  void processFuncMode(const TraceStore &store, const TraceBlock &block,
+                       const FilteredFunctions &filtered,
                        perfetto::Track &parent_track,
-                       const std::string &device_name);
+                       const ViewConfig &view_config);
 
   /**
    * 处理 Cnt 模式
+   * @param filtered 过滤后的计数器视图
+   * @param parent_track 父轨道
    */
-  void processCntMode(const unified_perf_format::BatchCounter &batch_counter,
+  void processCntMode(const TraceStore &store, const TraceBlock &block,
+                      const FilteredCounters &filtered,
                       perfetto::Track &parent_track);
 
   /**
@@ -122,51 +290,102 @@ private:
   /**
    * 检查是否通过时间线过滤器
    */
-  bool passTimelineFilter(const std::vector<FilterRule> &filters, uint64_t start_time, uint64_t end_time);
+  bool passTimelineFilter(const TimelineFilter &filter, uint64_t start_time, uint64_t end_time);
 
   /**
    * 检查是否通过事件过滤器
    */
-  bool passEventFilter(const std::vector<FilterRule> &filters, const std::string &event_name);
+  bool passEventFilter(const NameBitset &bits, uint32_t event_name_id);
 
   /**
    * 检查是否通过轨道过滤器
    */
-  bool passTrackFilter(const std::vector<FilterRule> &filters, const std::string &track_name);
+  bool passTrackFilter(const NameBitset &bits, uint32_t track_name_id);
 
   /**
    * 检查是否通过设备过滤器
    */
-  bool passDeviceFilter(const std::vector<FilterRule> &filters, const std::string &device_name);
+  bool passDeviceFilter(const SubstringMatcher &matcher, const std::string &device_name);
 
   /**
    * 检查是否通过线程过滤器
    */
-  bool passThreadFilter(const std::vector<FilterRule> &filters, uint32_t thread_id);
+  bool passThreadFilter(const ThreadFilter &filter, uint32_t thread_id);
 
   /**
    * 根据视图配置处理数据
    * @param view_config 视图配置
-   * @param perf_data_list 已经读取的性能数据列表
+   * @param store 已经读取的列式数据
    * @param view_track 该视图对应的 track（父轨道）
    */
   void processDataWithView(const ViewConfig &view_config, 
-                           const std::vector<unified_perf_format::UnifiedPerfData> &perf_data_list,
+                           const TraceStore &store,
                            perfetto::Track &view_track);
+
+  /**
+   * 融合模式：对数据块只遍历一次，每条记录依次判断所有视图的过滤条件，
+   * 并分发到匹配视图的过滤结果中，每个数据块遍历完后再按视图顺序输出
+   * @param view_configs 视图配置列表
+   * @param store 已经读取的列式数据
+   * @param view_tracks 与 view_configs 一一对应的视图 track
+   */
+  void processDataWithViews(const std::vector<const ViewConfig *> &view_configs,
+                            const TraceStore &store,
+                            const std::vector<perfetto::Track *> &view_tracks);
+
+  /**
+   * 对单条指令应用视图过滤器，通过的指令及 stage 追加到 filtered 中
+   * check_timeline 为 false 表示整个数据块都在时间线过滤范围内，无需逐条检查
+   * @param store 列式数据（名称 ID 与 where 表达式使用）
+   * @param block 指令所在的数据块
+   * @param inst 指令在数据块中的下标
+   */
+  void filterInstruction(const ViewConfig &view_config,
+                         const NameFilterBits &name_bits,
+                         const TraceStore &store,
+                         const TraceBlock &block,
+                         uint32_t inst,
+                         FilteredInstructions &filtered,
+                         bool check_timeline);
+
+  /**
+   * 对单个函数应用视图过滤器，通过时追加到 filtered 中
+   */
+  void filterFunction(const ViewConfig &view_config,
+                      const NameFilterBits &name_bits,
+                      const TraceStore &store,
+                      const TraceBlock &block,
+                      uint32_t func,
+                      FilteredFunctions &filtered,
+                      bool check_timeline);
+
+  /**
+   * 对单个计数器应用视图过滤器，通过的采样点追加到 filtered 中
+   */
+  void filterCounter(const ViewConfig &view_config,
+                     const NameFilterBits &name_bits,
+                     const TraceStore &store,
+                     const TraceBlock &block,
+                     uint32_t cnt,
+                     FilteredCounters &filtered,
+                     bool check_timeline);
   
   /**
-   * 从文件读取性能数据（支持单个或多个消息格式）
+   * 从文件读取性能数据（支持单个或多个消息格式），每个数据块解析后立即转换为列式存储，
+   * protobuf 消息不会保留到读取结束之后
    * @param bin_file_path 数据文件路径
-   * @return 读取到的性能数据列表
+   * @param store 转换后的数据块追加到其中
+   * @return 读取到的数据块个数
    */
-  std::vector<unified_perf_format::UnifiedPerfData> readPerfDataFromFile(const std::string &bin_file_path);
+  size_t readPerfDataFromFile(const std::string &bin_file_path, TraceStore &store);
   
   /**
-   * 从多个文件读取性能数据并合并
+   * 从多个文件并行读取性能数据并按文件列表顺序合并
    * @param bin_file_paths 数据文件路径列表
-   * @return 合并后的性能数据列表
+   * @param jobs 并行线程数，<= 0 表示使用硬件并发数
+   * @return 合并后的列式数据
    */
-  std::vector<unified_perf_format::UnifiedPerfData> readPerfDataFromFiles(const std::vector<std::string> &bin_file_paths);
+  TraceStore readPerfDataFromFiles(const std::vector<std::string> &bin_file_paths, int jobs);
 
   /**
    * 加载 role 配置
@@ -184,7 +403,12 @@ private:
 
   PerfettoWrapper perfetto_wrapper_;
   bool initialized_;
+  int jobs_;                // 命令行指定的并行线程数
+  std::unique_ptr<ThreadPool> worker_pool_;  // 输出阶段使用的线程池（pipe 模式分组排序），在 show() 中创建
+  int buf_size_kb_;         // SDK 后端的缓冲区大小（KB）
+  std::string backend_;     // 命令行指定的追踪输出后端
   RoleConfig role_config_;  // Role 配置，用于线程名称映射
+  uint64_t next_flow_id_;   // 下一条依赖边的 flow id，所有视图共用以保证全局唯一
 };
 
 #endif // PERF_SHOWER_HH
@@ -1,15 +1,24 @@
 #ifndef PERFETTO_WRAPPER_HH
 #define PERFETTO_WRAPPER_HH
 
+#include <initializer_list>
 #include <memory>
 #include <string>
 #include <vector>
 #include "trace_categories.h"
-#include "unified_perf_format.pb.h"
+#include "trace_stream_writer.hh"
+
+class MetadataKeyFilter;
 
 /**
  * PerfettoWrapper 类：封装 perfetto 追踪接口
  * 提供简洁的 API 供上层用户自定义添加 track 和 event
+ *
+ * 支持两种后端，由调用的启动函数决定：
+ *   - start()：进程内 Perfetto SDK 会话，事件先写入追踪缓冲区，end() 时一次性读出写文件
+ *   - startStream()：TraceStreamWriter 直接把 TracePacket 流式写入输出文件，
+ *     不经过 SDK 的缓冲区，内存占用与 trace 大小无关
+ * 两种后端的 track uuid 与层级相同，上层代码无需区分。
  */
 class PerfettoWrapper {
 public:
@@ -22,13 +31,28 @@ public:
 
     /**
      * 初始化 perfetto 追踪系统
+     * 指定输出路径时，追踪缓冲区使用 DISCARD 策略并周期性写入文件（write_into_file），
+     * 缓冲区只需容纳一个写入周期的数据；不指定时使用 RING_BUFFER，整个 trace 必须能放进缓冲区
      * @param buf_size_kb 缓冲区大小（KB）
+     * @param perf_path 输出文件路径，为空时在 end() 中一次性读出并写文件
      */
-    void start(int buf_size_kb = 409600);
+    void start(int buf_size_kb = 409600, const std::string& perf_path = "");
 
     /**
-     * 结束追踪并保存到文件
+     * 使用流式后端：直接创建输出文件，之后的 track 和 event 立即写入文件
      * @param perf_path 输出文件路径
+     * @return 是否成功创建输出文件
+     */
+    bool startStream(const std::string& perf_path);
+
+    /**
+     * 是否使用流式后端
+     */
+    bool isStreaming() const { return stream_writer_ != nullptr; }
+
+    /**
+     * 结束追踪并保存到文件，同时输出追踪缓冲区的统计（覆盖、丢弃的 chunk 数）
+     * @param perf_path 输出文件路径（流式后端或 start() 指定了输出路径时，忽略该参数）
      */
     void end(const std::string& perf_path);
 
@@ -74,33 +98,36 @@ public:
      * @param track 命名轨道引用
      * @param start_cycle 开始时间戳（周期）
      * @param end_cycle 结束时间戳（周期）
-     * @param msg 事件消息
+     * @param metadata 依次写为 debug annotation 的各组 metadata
+     * @param key_filter metadata 键过滤器，为空时输出所有键；被过滤的键不会被驻留或序列化
      */
     void addTraceEvent(
         const std::string& title_name,
         perfetto::NamedTrack& track,
         uint64_t start_cycle,
         uint64_t end_cycle,
-        const google::protobuf::Map<std::string, std::string>& common_metadata,
-        const google::protobuf::Map<std::string, std::string>& metadata);
+        std::initializer_list<MetadataSpan> metadata,
+        const MetadataKeyFilter* key_filter = nullptr);
 
     /**
-     * 添加带流控制的追踪事件
+     * 添加带 flow 箭头的追踪事件
+     * flow id 为全局 id，相同 id 的 outgoing 与 terminating 事件之间画出箭头
      * @param title_name 事件标题
      * @param track 命名轨道引用
      * @param start_cycle 开始时间戳（周期）
      * @param end_cycle 结束时间戳（周期）
-     * @param flow_id 流ID
-     * @param msg 事件消息
+     * @param flows 从该事件出发和在该事件结束的 flow id
+     * @param metadata 依次写为 debug annotation 的各组 metadata
+     * @param key_filter metadata 键过滤器，为空时输出所有键
      */
     void addTraceEventWithFlow(
         const std::string& title_name,
         perfetto::NamedTrack& track,
         uint64_t start_cycle,
         uint64_t end_cycle,
-        uint64_t flow_id,
-        const google::protobuf::Map<std::string, std::string>& common_metadata,
-        const google::protobuf::Map<std::string, std::string>& metadata);
+        const EventFlows& flows,
+        std::initializer_list<MetadataSpan> metadata,
+        const MetadataKeyFilter* key_filter = nullptr);
 
     /**
      * 获取系统轨道（根轨道）
@@ -109,9 +136,19 @@ public:
     perfetto::Track& getSystemTrack() { return system_track_; }
 
 private:
+    static constexpr uint32_t kFileWritePeriodMs = 250;      // 缓冲区写入文件的周期
+    static constexpr uint32_t kShmemSizeHintKb = 16 * 1024;  // 生产者共享内存缓冲区大小
+
+    /**
+     * 输出追踪缓冲区统计
+     * @return 是否没有 chunk 被覆盖或丢弃
+     */
+    bool reportTraceStats();
+
     uint64_t track_cnt_;                    // 轨道计数器
-    uint64_t flow_range_id_;                // 流范围ID
+    int trace_fd_;                          // write_into_file 的输出文件，-1 表示未使用
     std::unique_ptr<perfetto::TracingSession> tracing_session_;  // 追踪会话
+    std::unique_ptr<TraceStreamWriter> stream_writer_;           // 流式后端，为空时使用 SDK 会话
     perfetto::Track system_track_;          // 系统轨道（根轨道）
 };
 
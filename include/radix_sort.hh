@@ -0,0 +1,92 @@
+#ifndef RADIX_SORT_HH
+#define RADIX_SORT_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * 按 64 位键升序做 LSD 基数排序（稳定排序，键相同的元素保持原有顺序）
+ *
+ * 先扫描一遍求出键的最小值、最大值并检查是否已经有序（已有序时直接返回）；
+ * 之后对 (键 - 最小值) 按 11 位一趟排序，只处理实际变化的位，
+ * 例如跨度在 2^33 以内的时间戳只需 3 趟。所有趟的直方图在一次扫描中统计完。
+ * 元素较少时退化为 std::stable_sort。
+ *
+ * 元素会在 items 与 buffer 之间整体搬移，值类型应尽量小（如下标）。
+ *
+ * @param items 待排序的 (键, 值) 数组
+ * @param buffer 临时缓冲区，大小会被调整为 items.size()，可在多次调用间复用
+ */
+template <class T>
+void radixSortByKey(std::vector<std::pair<uint64_t, T>> &items,
+                    std::vector<std::pair<uint64_t, T>> &buffer) {
+  constexpr size_t kSmallSize = 64;
+  constexpr int kDigitBits = 11;
+  constexpr size_t kBuckets = size_t(1) << kDigitBits;
+  constexpr uint64_t kDigitMask = kBuckets - 1;
+  const size_t n = items.size();
+  if (n < kSmallSize) {
+    std::stable_sort(items.begin(), items.end(),
+                     [](const std::pair<uint64_t, T> &a, const std::pair<uint64_t, T> &b) {
+                       return a.first < b.first;
+                     });
+    return;
+  }
+
+  uint64_t min_key = items[0].first;
+  uint64_t max_key = items[0].first;
+  bool sorted = true;
+  for (size_t i = 1; i < n; i++) {
+    uint64_t key = items[i].first;
+    sorted = sorted && items[i - 1].first <= key;
+    min_key = std::min(min_key, key);
+    max_key = std::max(max_key, key);
+  }
+  if (sorted) {
+    return;
+  }
+
+  uint64_t range = max_key - min_key;
+  int passes = 0;
+  while (passes * kDigitBits < 64 && (range >> (passes * kDigitBits)) != 0) {
+    passes++;
+  }
+
+  std::vector<size_t> counts(passes * kBuckets, 0);
+  for (const auto &item : items) {
+    uint64_t key = item.first - min_key;
+    for (int pass = 0; pass < passes; pass++) {
+      counts[pass * kBuckets + ((key >> (pass * kDigitBits)) & kDigitMask)]++;
+    }
+  }
+
+  buffer.resize(n);
+  auto *src = &items;
+  auto *dst = &buffer;
+  for (int pass = 0; pass < passes; pass++) {
+    size_t *count = &counts[pass * kBuckets];
+    int shift = pass * kDigitBits;
+    // 所有键在这一位段上都相同，这一趟不改变顺序
+    if (count[((items.front().first - min_key) >> shift) & kDigitMask] == n) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t digit = 0; digit < kBuckets; digit++) {
+      size_t c = count[digit];
+      count[digit] = offset;
+      offset += c;
+    }
+    for (const auto &item : *src) {
+      (*dst)[count[((item.first - min_key) >> shift) & kDigitMask]++] = item;
+    }
+    std::swap(src, dst);
+  }
+  if (src != &items) {
+    items.swap(buffer);
+  }
+}
+
+#endif // RADIX_SORT_HH
@@ -0,0 +1,68 @@
+#ifndef STRING_INTERNER_HH
+#define STRING_INTERNER_HH
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * StringInterner 类：字符串驻留表
+ * 把重复出现的名称（stage name、show_title、function name 等）映射为从 0 开始的连续整数 ID，
+ * 之后的过滤与查找只比较 ID，不再做字符串操作。
+ * 字符串保存在 deque 中，地址在整个生命周期内保持不变。
+ */
+class StringInterner {
+public:
+  static constexpr uint32_t kInvalidId = UINT32_MAX;
+
+  StringInterner() = default;
+  StringInterner(const StringInterner &) = delete;
+  StringInterner &operator=(const StringInterner &) = delete;
+  StringInterner(StringInterner &&) = default;
+  StringInterner &operator=(StringInterner &&) = default;
+
+  /**
+   * 获取字符串对应的 ID，不存在时分配新的 ID
+   * @param str 字符串
+   * @return 字符串 ID
+   */
+  uint32_t intern(std::string_view str);
+
+  /**
+   * 查找字符串对应的 ID
+   * @return 字符串 ID，不存在时返回 kInvalidId
+   */
+  uint32_t find(std::string_view str) const;
+
+  /**
+   * 获取 ID 对应的字符串
+   */
+  const std::string &str(uint32_t id) const { return strings_[id]; }
+
+  /**
+   * 已驻留的字符串个数（即下一个新 ID）
+   */
+  size_t size() const { return strings_.size(); }
+
+private:
+  std::deque<std::string> strings_;
+  std::unordered_map<std::string_view, uint32_t> ids_;  // key 指向 strings_ 中的字符串
+};
+
+/**
+ * 一组 metadata 键值对的只读视图：键和值都是 strings 中的驻留 ID，keys[i] 与 values[i] 成对
+ */
+struct MetadataSpan {
+  const StringInterner *strings = nullptr;
+  const uint32_t *keys = nullptr;
+  const uint32_t *values = nullptr;
+  size_t size = 0;
+
+  bool empty() const { return size == 0; }
+  const std::string &key(size_t i) const { return strings->str(keys[i]); }
+  const std::string &value(size_t i) const { return strings->str(values[i]); }
+};
+
+#endif // STRING_INTERNER_HH
@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * ThreadPool 类：固定线程数的简单线程池
+ * 任务按提交顺序出队执行，结果的顺序由调用方通过下标自行保证
+ */
+class ThreadPool {
+public:
+  /**
+   * @param num_threads 工作线程数，为 0 时使用硬件并发数
+   */
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * 提交一个任务
+   */
+  void submit(std::function<void()> task);
+
+  /**
+   * 阻塞等待所有已提交的任务执行完毕
+   */
+  void wait();
+
+  /**
+   * 并行执行 func(0) ... func(n-1)，返回时全部执行完毕
+   */
+  void parallelFor(size_t n, const std::function<void(size_t)> &func);
+
+  size_t size() const { return workers_.size(); }
+
+  /**
+   * 根据配置的任务数计算实际线程数
+   * @param jobs 配置的并发数，<= 0 表示使用硬件并发数
+   * @param max_tasks 任务总数上限，线程数不会超过它
+   */
+  static size_t resolveJobs(int jobs, size_t max_tasks);
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable task_cv_;
+  std::condition_variable done_cv_;
+  size_t pending_;  // 已提交但尚未执行完的任务数
+  bool stop_;
+};
+
+#endif // THREAD_POOL_HH
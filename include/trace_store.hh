@@ -0,0 +1,128 @@
+#ifndef TRACE_STORE_HH
+#define TRACE_STORE_HH
+
+#include "string_interner.hh"
+#include "unified_perf_format.pb.h"
+#include "view_filters.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * 一个数据块（UnifiedPerfData）的列式存储（struct-of-arrays）
+ *
+ * 每种记录的每个字段存成一个数组，名称和 metadata 字符串都是驻留 ID，
+ * 过滤时只顺序扫描需要的列。变长的子记录（stage、parent_seq_num、metadata、采样点）
+ * 按所属记录的顺序连续存放：记录 i 的子记录为 [xxx_begin[i], xxx_begin[i + 1])。
+ * 名称 ID 指向 TraceStore::names，metadata 的键值 ID 指向 TraceStore::strings。
+ */
+struct TraceBlock {
+  enum class Kind { kEmpty, kInstructions, kFunctions, kCounters };
+
+  Kind kind = Kind::kEmpty;  // 由 UnifiedPerfData 的 payload 决定
+  std::string device_name;
+  TimeSpan span;             // 所有 stage / 函数 / 采样点的时间跨度
+
+  // Instruction
+  std::vector<uint32_t> inst_names;
+  std::vector<uint32_t> inst_threads;
+  std::vector<uint64_t> inst_seqs;          // global_seq_num
+  std::vector<uint32_t> inst_stage_begin;   // 指令个数 + 1
+  std::vector<uint32_t> inst_parent_begin;  // 指令个数 + 1
+  std::vector<uint32_t> inst_meta_begin;    // 指令个数 + 1
+  std::vector<uint64_t> parent_seqs;        // parent_seq_num
+
+  // Stage（按指令顺序展开）
+  std::vector<uint64_t> stage_starts;
+  std::vector<uint64_t> stage_ends;
+  std::vector<uint32_t> stage_names;        // pipe 模式按它分 track
+  std::vector<uint32_t> stage_events;       // 事件名：show_title，为空时与 stage_names 相同
+  std::vector<uint32_t> stage_meta_begin;   // stage 个数 + 1
+
+  // Function
+  std::vector<uint32_t> func_names;
+  std::vector<uint32_t> func_threads;
+  std::vector<uint64_t> func_starts;
+  std::vector<uint64_t> func_ends;
+  std::vector<uint32_t> func_meta_begin;    // 函数个数 + 1
+
+  // Counter
+  std::vector<uint32_t> cnt_names;
+  std::vector<uint32_t> cnt_units;          // unit 同样驻留在 names 中
+  std::vector<uint32_t> cnt_sample_begin;   // 计数器个数 + 1
+  std::vector<uint32_t> cnt_meta_begin;     // 计数器个数 + 1
+  std::vector<uint64_t> sample_times;
+  std::vector<double> sample_values;
+
+  // 所有记录的 metadata 键值对，按记录内的原始顺序存放
+  std::vector<uint32_t> meta_keys;
+  std::vector<uint32_t> meta_values;
+
+  size_t instCount() const { return inst_names.size(); }
+  size_t funcCount() const { return func_names.size(); }
+  size_t cntCount() const { return cnt_names.size(); }
+
+  /**
+   * 列数组占用的字节数
+   */
+  size_t memoryBytes() const;
+};
+
+/**
+ * TraceStore：读取阶段构建一次的列式数据，之后的过滤和各模式输出都只访问它
+ * protobuf 消息在转换后立即释放，不会在整个处理过程中常驻内存
+ */
+struct TraceStore {
+  std::vector<TraceBlock> blocks;  // 按文件列表顺序合并的数据块
+  StringInterner names;            // 记录名称、stage show_title、计数器单位
+  StringInterner strings;          // metadata 的键和值
+
+  /**
+   * 把一个 protobuf 数据块转换为列式存储并追加到 blocks 末尾
+   * 字符串字段和字典编码（*_id）两种形式都接受，字符串表中的每一项只驻留一次；
+   * 计数器的 values 和打包采样点都解码到连续的采样列中
+   * @param perf_data 数据块
+   * @param shared_table 容器级的字符串表，数据块自带 string_table 时忽略
+   * @return 引用了不存在的字符串 ID、metadata_ids 不成对或打包采样点的个数不一致时返回 false，
+   *         不追加数据块
+   */
+  bool add(const unified_perf_format::UnifiedPerfData &perf_data,
+           const google::protobuf::RepeatedPtrField<std::string> *shared_table = nullptr);
+
+  /**
+   * 把另一个 store（通常是一个输入文件的读取结果）的数据块移动到末尾，驻留 ID 重映射为本 store 的 ID
+   */
+  void append(TraceStore &&other);
+
+  /**
+   * 列数组与驻留字符串占用的字节数（估算值，不含哈希表）
+   */
+  size_t memoryBytes() const;
+
+  MetadataSpan instMetadata(const TraceBlock &block, size_t inst) const {
+    return metadata(block, block.inst_meta_begin, inst);
+  }
+  MetadataSpan stageMetadata(const TraceBlock &block, size_t stage) const {
+    return metadata(block, block.stage_meta_begin, stage);
+  }
+  MetadataSpan funcMetadata(const TraceBlock &block, size_t func) const {
+    return metadata(block, block.func_meta_begin, func);
+  }
+  MetadataSpan cntMetadata(const TraceBlock &block, size_t cnt) const {
+    return metadata(block, block.cnt_meta_begin, cnt);
+  }
+
+private:
+  MetadataSpan metadata(const TraceBlock &block, const std::vector<uint32_t> &begin,
+                        size_t index) const {
+    MetadataSpan span;
+    span.strings = &strings;
+    span.keys = block.meta_keys.data() + begin[index];
+    span.values = block.meta_values.data() + begin[index];
+    span.size = begin[index + 1] - begin[index];
+    return span;
+  }
+};
+
+#endif // TRACE_STORE_HH
@@ -0,0 +1,142 @@
+#ifndef TRACE_STREAM_WRITER_HH
+#define TRACE_STREAM_WRITER_HH
+
+#include "string_interner.hh"
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+class MetadataKeyFilter;
+
+/**
+ * slice 开始事件上的 flow：outgoing 中的 flow 从该事件出发，terminating 中的 flow 在该事件结束
+ */
+struct EventFlows {
+  const uint64_t *outgoing = nullptr;
+  size_t outgoing_count = 0;
+  const uint64_t *terminating = nullptr;
+  size_t terminating_count = 0;
+
+  bool empty() const { return outgoing_count == 0 && terminating_count == 0; }
+};
+
+/**
+ * TraceStreamWriter 类：不经过 Perfetto SDK，直接把 TracePacket 写入 .perfetto 文件
+ *
+ * 输出文件就是 perfetto.protos.Trace 消息：每个 TracePacket 作为 Trace.packet（字段 1）依次追加，
+ * TrackDescriptor / TrackEvent 按 perfetto 的 proto 字段号用 CodedOutputStream 手工编码，
+ * 先计算消息长度再直接写入带缓冲的文件流，不构造任何中间消息对象。
+ *
+ * 事件名、debug annotation 的名称和字符串值都通过 InternedData 驻留：
+ * 每个字符串在首次出现的 packet 中随 interned_data 写出一次，之后的事件只引用 iid。
+ * 内存占用为文件流的缓冲区加上驻留表，驻留表只随不同字符串的个数增长。
+ *
+ * 所有 packet 都属于同一个写入序列（trusted_packet_sequence_id），不是线程安全的。
+ */
+class TraceStreamWriter {
+public:
+  // TrackDescriptor.child_ordering 的取值
+  enum ChildOrdering { kOrderingUnknown = 0, kOrderingLexicographic = 1,
+                       kOrderingChronological = 2, kOrderingExplicit = 3 };
+
+  TraceStreamWriter();
+  ~TraceStreamWriter();
+
+  TraceStreamWriter(const TraceStreamWriter &) = delete;
+  TraceStreamWriter &operator=(const TraceStreamWriter &) = delete;
+
+  /**
+   * 创建输出文件
+   * @param file_path 输出文件路径
+   * @param buffer_size 文件流缓冲区大小（字节）
+   * @return 是否成功
+   */
+  bool open(const std::string &file_path, int buffer_size = 1 << 20);
+
+  /**
+   * 刷新缓冲并关闭文件
+   * @return 写入过程中是否没有出错
+   */
+  bool close();
+
+  bool isOpen() const { return coded_ != nullptr; }
+
+  /**
+   * 写入轨道描述
+   * @param uuid 轨道 uuid
+   * @param parent_uuid 父轨道 uuid，0 表示没有父轨道
+   * @param name 显示名称
+   * @param child_ordering 子轨道排序方式
+   * @param sibling_order_rank 在兄弟轨道中的排序值
+   */
+  void writeTrackDescriptor(uint64_t uuid, uint64_t parent_uuid, const std::string &name,
+                            ChildOrdering child_ordering, int32_t sibling_order_rank);
+
+  /**
+   * 写入计数器轨道描述
+   * @param unit_name 单位名称
+   */
+  void writeCounterTrackDescriptor(uint64_t uuid, uint64_t parent_uuid, const std::string &name,
+                                   const std::string &unit_name);
+
+  /**
+   * 写入 slice 开始事件，各组 metadata 按顺序写为 debug annotation
+   * @param flows 非空时写入其中的 flow_ids / terminating_flow_ids
+   * @param key_filter 非空时只写入通过过滤的 metadata 键
+   */
+  void writeSliceBegin(uint64_t timestamp, uint64_t track_uuid, const std::string &name,
+                       std::initializer_list<MetadataSpan> metadata,
+                       const EventFlows *flows = nullptr,
+                       const MetadataKeyFilter *key_filter = nullptr);
+
+  /**
+   * 写入 slice 结束事件
+   */
+  void writeSliceEnd(uint64_t timestamp, uint64_t track_uuid);
+
+  /**
+   * 写入计数器采样
+   */
+  void writeCounter(uint64_t timestamp, uint64_t track_uuid, double value);
+
+  uint64_t packetCount() const { return packet_cnt_; }
+  uint64_t bytesWritten() const;
+
+private:
+  // 写入 TracePacket 头部（Trace.packet 的 tag 和长度）以及时间戳、序列号等公共字段
+  void beginPacket(size_t payload_size, bool has_timestamp, uint64_t timestamp,
+                   uint32_t sequence_flags);
+  size_t packetFieldsSize(bool has_timestamp, uint64_t timestamp, uint32_t sequence_flags) const;
+
+  // 获取字符串的 iid（驻留 ID + 1），首次出现时把 iid 加入 new_iids
+  uint64_t internString(StringInterner &table, const std::string &str,
+                        std::vector<uint64_t> &new_iids);
+  size_t internedEntriesSize(uint32_t field, const StringInterner &table,
+                             const std::vector<uint64_t> &iids) const;
+  void writeInternedEntries(uint32_t field, const StringInterner &table,
+                            const std::vector<uint64_t> &iids);
+
+  int fd_;
+  std::unique_ptr<google::protobuf::io::FileOutputStream> file_stream_;
+  std::unique_ptr<google::protobuf::io::CodedOutputStream> coded_;
+  uint64_t packet_cnt_;
+  bool first_packet_;
+
+  bool category_interned_;                 // "cpu.common" 分类是否已写出
+  StringInterner event_names_;             // InternedData.event_names
+  StringInterner annotation_names_;        // InternedData.debug_annotation_names
+  StringInterner annotation_values_;       // InternedData.debug_annotation_string_values
+
+  // writeSliceBegin 的临时数组，复用以避免每个事件分配内存
+  std::vector<uint64_t> new_event_names_;
+  std::vector<uint64_t> new_annotation_names_;
+  std::vector<uint64_t> new_annotation_values_;
+  std::vector<std::pair<uint64_t, uint64_t>> annotations_;  // (name iid, value iid)
+};
+
+#endif // TRACE_STREAM_WRITER_HH
@@ -0,0 +1,221 @@
+#ifndef VIEW_FILTERS_HH
+#define VIEW_FILTERS_HH
+
+#include "string_interner.hh"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * 数据块或记录的时间跨度（闭区间）
+ */
+struct TimeSpan {
+  uint64_t start = UINT64_MAX;
+  uint64_t end = 0;
+
+  bool empty() const { return start > end; }
+  void extend(uint64_t s, uint64_t e) {
+    // 不假设 s <= e，保证跨度总能覆盖两个端点
+    start = std::min(start, std::min(s, e));
+    end = std::max(end, std::max(s, e));
+  }
+};
+
+/**
+ * 编译后的时间线过滤器
+ * 在 parseShowJson 中由 "start-end" / "timestamp" 规则编译一次，
+ * 所有规则转换为闭区间后排序并合并，匹配时使用二分查找
+ */
+class TimelineFilter {
+public:
+  /**
+   * 编译过滤规则，非法规则会被忽略并打印警告
+   * @param rules timeline_filter 中的规则字符串
+   */
+  void compile(const std::vector<std::string> &rules);
+
+  /**
+   * 是否配置了过滤规则（未配置时所有数据都通过）
+   */
+  bool enabled() const { return enabled_; }
+
+  /**
+   * 检查 [start_time, end_time] 是否与任一过滤区间重叠
+   */
+  bool pass(uint64_t start_time, uint64_t end_time) const {
+    if (!enabled_) return true;
+    return overlaps(start_time, end_time);
+  }
+
+  /**
+   * 整个时间跨度是否与过滤区间完全没有交集（可以整体跳过）
+   */
+  bool excludes(const TimeSpan &span) const {
+    return enabled_ && (span.empty() || !overlaps(span.start, span.end));
+  }
+
+  /**
+   * 整个时间跨度是否被某个过滤区间完全覆盖（其中每条记录都必然通过）
+   */
+  bool covers(const TimeSpan &span) const;
+
+  const std::vector<std::pair<uint64_t, uint64_t>> &intervals() const { return intervals_; }
+
+private:
+  bool overlaps(uint64_t start_time, uint64_t end_time) const;
+
+  bool enabled_ = false;
+  std::vector<std::pair<uint64_t, uint64_t>> intervals_;  // 按起点排序且互不相交的闭区间
+};
+
+/**
+ * 编译后的多模式子串匹配器（event_filter / track_filter / device_filter 使用）
+ *
+ * 所有模式构建为一个 Aho–Corasick 自动机，对名称只扫描一遍即可判断是否包含任一模式；
+ * 扫描前先用模式首字节做预筛选（SSE2 一次比较 16 字节），跳过不可能出现匹配的前缀。
+ * 同名记录（如 stage 名）会大量重复，匹配结果按名称缓存。
+ *
+ * 缓存不加锁，同一个匹配器不能被多个线程同时使用。
+ */
+class SubstringMatcher {
+public:
+  /**
+   * 编译模式集合
+   * @param patterns 子串模式，空串匹配任意名称
+   */
+  void compile(const std::vector<std::string> &patterns);
+
+  /**
+   * 是否配置了模式（未配置时所有名称都通过）
+   */
+  bool enabled() const { return enabled_; }
+
+  /**
+   * 名称中是否包含任一模式（未配置模式时返回 true）
+   */
+  bool matches(const std::string &name) const;
+
+private:
+  // 预筛选最多使用的不同首字节个数，超过后直接运行自动机
+  static constexpr size_t kMaxPrefilterBytes = 4;
+  // 结果缓存的最大条目数，防止名称种类过多时无限增长
+  static constexpr size_t kMaxCacheEntries = 1 << 16;
+
+  bool scan(const char *data, size_t size) const;
+  size_t findCandidate(const char *data, size_t size) const;
+
+  bool enabled_ = false;
+  bool match_all_ = false;                    // 含空模式，任意名称都匹配
+  uint32_t class_count_ = 0;                  // 字节等价类个数（模式中出现的字节 + 其他）
+  uint8_t byte_class_[256] = {};              // 字节 -> 等价类，0 表示不在任何模式中出现
+  std::vector<uint32_t> transitions_;         // 状态 * class_count_ + 类 -> 下一状态
+  std::vector<uint8_t> accept_;               // 状态是否匹配了某个模式（已沿失败链传播）
+  std::vector<uint8_t> first_bytes_;          // 所有模式的不同首字节，个数不超过阈值时用于预筛选
+  mutable std::unordered_map<std::string, bool> cache_;
+};
+
+/**
+ * 按驻留 ID 预先计算的名称过滤结果
+ * 每个不同的名称只匹配一次，逐条记录判断时只需查一次位图
+ */
+class NameBitset {
+public:
+  /**
+   * 对驻留表中的每个名称运行一次匹配器，记录是否通过
+   * @param matcher 名称匹配器（未配置规则时所有 ID 都通过）
+   * @param names 名称驻留表
+   */
+  void build(const SubstringMatcher &matcher, const StringInterner &names);
+
+  bool test(uint32_t id) const {
+    return all_ || ((words_[id >> 6] >> (id & 63)) & 1);
+  }
+
+private:
+  bool all_ = true;
+  std::vector<uint64_t> words_;
+};
+
+/**
+ * 编译后的线程过滤器
+ * 规则支持单个线程ID（"3"）、闭区间（"0-63"）以及 role.json 中的线程名称，
+ * 编译为按线程ID索引的位图，判断时只需一次位测试；
+ * 超出位图范围的大线程ID放在有序区间表中二分查找
+ */
+class ThreadFilter {
+public:
+  /**
+   * 编译过滤规则，非法规则或未知的线程名称会被忽略并打印警告
+   * @param rules thread_filter 中的规则字符串
+   * @param thread_names role 配置中的线程ID -> 名称映射
+   */
+  void compile(const std::vector<std::string> &rules,
+               const std::unordered_map<uint32_t, std::string> &thread_names);
+
+  /**
+   * 是否配置了过滤规则（未配置时所有线程都通过）
+   */
+  bool enabled() const { return enabled_; }
+
+  bool pass(uint32_t thread_id) const {
+    if (!enabled_) return true;
+    if (thread_id < kDenseLimit) {
+      return (thread_id >> 6) < bits_.size() && ((bits_[thread_id >> 6] >> (thread_id & 63)) & 1);
+    }
+    return passSparse(thread_id);
+  }
+
+private:
+  static constexpr uint32_t kDenseLimit = 1 << 16;  // 位图覆盖的线程ID上限
+
+  void add(uint32_t first, uint32_t last);
+  bool passSparse(uint32_t thread_id) const;
+
+  bool enabled_ = false;
+  std::vector<uint64_t> bits_;
+  std::vector<std::pair<uint32_t, uint32_t>> sparse_;  // >= kDenseLimit 的闭区间，有序且不相交
+};
+
+/**
+ * 编译后的 metadata 键过滤器（metadata_keys / drop_metadata_keys）
+ * 两个列表在 parseShowJson 中合并为一个驻留键集合：
+ *   - 配置了 metadata_keys 时只保留集合 metadata_keys - drop_metadata_keys 中的键
+ *   - 否则丢弃 drop_metadata_keys 中的键
+ * 判断时先按键长度做位掩码预筛选，大部分不在集合中的键不需要计算哈希
+ */
+class MetadataKeyFilter {
+public:
+  /**
+   * 编译键列表
+   * @param keep_keys metadata_keys，为空表示保留所有键
+   * @param drop_keys drop_metadata_keys
+   */
+  void compile(const std::vector<std::string> &keep_keys, const std::vector<std::string> &drop_keys);
+
+  /**
+   * 是否配置了键过滤（未配置时所有键都保留）
+   */
+  bool enabled() const { return keys_ != nullptr; }
+
+  bool pass(const std::string &key) const {
+    if (!keys_) return true;
+    return contains(key) == keep_listed_;
+  }
+
+private:
+  bool contains(const std::string &key) const {
+    size_t length = key.size() < 63 ? key.size() : 63;
+    if (!((length_mask_ >> length) & 1)) return false;
+    return keys_->find(key) != StringInterner::kInvalidId;
+  }
+
+  std::shared_ptr<const StringInterner> keys_;  // 视图配置拷贝时共享同一个集合
+  bool keep_listed_ = false;                     // true：只保留集合中的键；false：丢弃集合中的键
+  uint64_t length_mask_ = 0;                     // 第 n 位表示集合中有长度为 n 的键（>= 63 的长度记在第 63 位）
+};
+
+#endif // VIEW_FILTERS_HH
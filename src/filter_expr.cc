@@ -0,0 +1,891 @@
+#include "filter_expr.hh"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+// 表达式中可以引用的字段
+enum class ExprField {
+  kDevice, kThread,
+  kInstName, kInstSeq,
+  kStageName, kStageTitle, kStageStart, kStageEnd, kStageDuration,
+  kFuncName, kFuncStart, kFuncEnd, kFuncDuration,
+  kCntName, kCntUnit,
+  kMeta, kInstMeta, kStageMeta,
+};
+
+enum class ExprOp { kEq, kNe, kContains, kNotContains, kLt, kLe, kGt, kGe };
+
+struct ExprFieldInfo {
+  const char *name;
+  ExprField field;
+  bool numeric;      // 数值字段，只能与数字比较
+  bool stage_level;  // 需要逐 stage 求值
+};
+
+static const ExprFieldInfo kExprFields[] = {
+    {"device", ExprField::kDevice, false, false},
+    {"thread", ExprField::kThread, true, false},
+    {"inst.name", ExprField::kInstName, false, false},
+    {"inst.seq", ExprField::kInstSeq, true, false},
+    {"stage.name", ExprField::kStageName, false, true},
+    {"stage.title", ExprField::kStageTitle, false, true},
+    {"stage.start", ExprField::kStageStart, true, true},
+    {"stage.end", ExprField::kStageEnd, true, true},
+    {"stage.duration", ExprField::kStageDuration, true, true},
+    {"func.name", ExprField::kFuncName, false, false},
+    {"func.start", ExprField::kFuncStart, true, false},
+    {"func.end", ExprField::kFuncEnd, true, false},
+    {"func.duration", ExprField::kFuncDuration, true, false},
+    {"cnt.name", ExprField::kCntName, false, false},
+    {"cnt.unit", ExprField::kCntUnit, false, false},
+    // meta 在 instruction 上先查 stage 的 metadata，因此也是 stage 级别的字段
+    {"meta", ExprField::kMeta, false, true},
+    {"inst.meta", ExprField::kInstMeta, false, false},
+    {"stage.meta", ExprField::kStageMeta, false, true},
+};
+
+static const ExprFieldInfo &fieldInfo(ExprField field) {
+  for (const auto &info : kExprFields) {
+    if (info.field == field) return info;
+  }
+  return kExprFields[0];
+}
+
+static bool isMetaField(ExprField field) {
+  return field == ExprField::kMeta || field == ExprField::kInstMeta ||
+         field == ExprField::kStageMeta;
+}
+
+static const char *opText(ExprOp op) {
+  switch (op) {
+    case ExprOp::kEq: return "==";
+    case ExprOp::kNe: return "!=";
+    case ExprOp::kContains: return "~";
+    case ExprOp::kNotContains: return "!~";
+    case ExprOp::kLt: return "<";
+    case ExprOp::kLe: return "<=";
+    case ExprOp::kGt: return ">";
+    case ExprOp::kGe: return ">=";
+  }
+  return "?";
+}
+
+// 字面量：字符串保存去掉引号后的内容，数字同时保存原始文本和数值
+struct ExprLiteral {
+  std::string text;
+  bool is_number = false;
+  bool is_integer = false;  // 非负整数，可以按 uint64 精确比较
+  uint64_t uint_value = 0;
+  double double_value = 0;
+};
+
+// 求值时取到的字段值
+struct ExprValue {
+  bool present = false;
+  bool numeric = false;
+  uint64_t num = 0;
+  const std::string *str = nullptr;
+  uint32_t id = UINT32_MAX;  // 字符串值的驻留 ID（名称或 metadata 值），用于缓存比较结果
+};
+
+struct FilterExpr::Node {
+  enum Kind { kConst, kAnd, kOr, kNot, kCompare, kIn };
+
+  Kind kind = kConst;
+  bool value = false;                            // kConst
+  std::vector<std::unique_ptr<Node>> children;   // kAnd / kOr / kNot
+  ExprField field = ExprField::kDevice;          // kCompare / kIn
+  std::string meta_key;
+  ExprOp op = ExprOp::kEq;                       // kCompare
+  ExprLiteral literal;
+  std::vector<uint64_t> num_set;                 // kIn：有序，二分查找
+  std::vector<std::string> str_set;
+  int cost = 0;                                  // 估计的求值代价，用于短路排序
+  mutable std::vector<int8_t> id_cache;          // 字符串值 ID -> 结果（-1 表示未计算）
+  mutable const StringInterner *meta_table = nullptr;  // meta_key_id 所属的驻留表
+  mutable uint32_t meta_key_id = UINT32_MAX;     // meta_key 的驻留 ID，不存在时为 kInvalidId
+};
+
+using Node = FilterExpr::Node;
+
+// ---------------------------------------------------------------------------
+// 词法分析
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct Token {
+  enum Type { kEnd, kIdent, kString, kNumber, kPunct };
+  Type type = kEnd;
+  std::string text;
+  size_t pos = 0;
+};
+
+bool tokenize(const std::string &text, std::vector<Token> &tokens, std::string &error) {
+  static const char *kPuncts[] = {"&&", "||", "==", "!=", "!~", "<=", ">=",
+                                  "!", "~", "<", ">", "(", ")", "[", "]", ","};
+  size_t i = 0;
+  while (i < text.size()) {
+    char c = text[i];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      i++;
+      continue;
+    }
+    Token token;
+    token.pos = i;
+    if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+      size_t j = i;
+      while (j < text.size() &&
+             (std::isalnum(static_cast<unsigned char>(text[j])) || text[j] == '_' || text[j] == '.')) {
+        j++;
+      }
+      token.type = Token::kIdent;
+      token.text = text.substr(i, j - i);
+      i = j;
+    } else if (c == '"') {
+      size_t j = i + 1;
+      while (j < text.size() && text[j] != '"') {
+        if (text[j] == '\\' && j + 1 < text.size()) {
+          j++;
+        }
+        token.text.push_back(text[j]);
+        j++;
+      }
+      if (j >= text.size()) {
+        error = "字符串字面量缺少结束引号（位置 " + std::to_string(i) + "）";
+        return false;
+      }
+      token.type = Token::kString;
+      i = j + 1;
+    } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+               (c == '-' && i + 1 < text.size() &&
+                std::isdigit(static_cast<unsigned char>(text[i + 1])))) {
+      size_t j = i + 1;
+      while (j < text.size() &&
+             (std::isalnum(static_cast<unsigned char>(text[j])) || text[j] == '.')) {
+        j++;
+      }
+      token.type = Token::kNumber;
+      token.text = text.substr(i, j - i);
+      i = j;
+    } else {
+      bool matched = false;
+      for (const char *punct : kPuncts) {
+        size_t len = std::strlen(punct);
+        if (text.compare(i, len, punct) == 0) {
+          token.type = Token::kPunct;
+          token.text = punct;
+          i += len;
+          matched = true;
+          break;
+        }
+      }
+      if (!matched) {
+        error = std::string("无法识别的字符 '") + c + "'（位置 " + std::to_string(i) + "）";
+        return false;
+      }
+    }
+    tokens.push_back(std::move(token));
+  }
+  Token end;
+  end.pos = text.size();
+  tokens.push_back(end);
+  return true;
+}
+
+bool parseNumber(const std::string &text, ExprLiteral &literal) {
+  literal.text = text;
+  literal.is_number = true;
+  char *end = nullptr;
+  literal.double_value = std::strtod(text.c_str(), &end);
+  if (end == text.c_str() || *end != '\0') {
+    return false;
+  }
+  if (text.find_first_not_of("0123456789") == std::string::npos) {
+    errno = 0;
+    literal.uint_value = std::strtoull(text.c_str(), nullptr, 10);
+    literal.is_integer = errno == 0;
+  }
+  return true;
+}
+
+// 整个字符串都是数字时转换为 double（用于 metadata 的大小比较）
+bool toDouble(const std::string &text, double &value) {
+  if (text.empty()) return false;
+  char *end = nullptr;
+  value = std::strtod(text.c_str(), &end);
+  return end != text.c_str() && *end == '\0';
+}
+
+// ---------------------------------------------------------------------------
+// 求值
+// ---------------------------------------------------------------------------
+
+// 在 metadata 键值对中按键的驻留 ID 查找，返回值的驻留 ID，不存在时返回 UINT32_MAX
+uint32_t findMeta(const MetadataSpan &metadata, uint32_t key_id) {
+  for (size_t i = 0; i < metadata.size; i++) {
+    if (metadata.keys[i] == key_id) {
+      return metadata.values[i];
+    }
+  }
+  return UINT32_MAX;
+}
+
+ExprValue fetch(const Node &node, const FilterRecord &r) {
+  ExprValue v;
+  const TraceBlock &b = *r.block;
+  const TraceStore &store = *r.store;
+  auto setNum = [&v](uint64_t num) {
+    v.present = true;
+    v.numeric = true;
+    v.num = num;
+  };
+  auto setStr = [&v](const std::string *str) {
+    v.present = str != nullptr;
+    v.str = str;
+  };
+  auto setId = [&v](const StringInterner &table, uint32_t id) {
+    if (id == UINT32_MAX) return;
+    v.present = true;
+    v.str = &table.str(id);
+    v.id = id;
+  };
+  auto metaKey = [&node, &store]() {
+    if (node.meta_table != &store.strings) {
+      node.meta_table = &store.strings;
+      node.meta_key_id = store.strings.find(node.meta_key);
+    }
+    return node.meta_key_id;
+  };
+  switch (node.field) {
+    case ExprField::kDevice: setStr(&b.device_name); break;
+    case ExprField::kThread:
+      if (r.inst != FilterRecord::kNone) setNum(b.inst_threads[r.inst]);
+      else if (r.func != FilterRecord::kNone) setNum(b.func_threads[r.func]);
+      break;
+    case ExprField::kInstName:
+      if (r.inst != FilterRecord::kNone) setId(store.names, b.inst_names[r.inst]);
+      break;
+    case ExprField::kInstSeq: if (r.inst != FilterRecord::kNone) setNum(b.inst_seqs[r.inst]); break;
+    case ExprField::kStageName:
+      if (r.stage != FilterRecord::kNone) setId(store.names, b.stage_names[r.stage]);
+      break;
+    case ExprField::kStageTitle:
+      if (r.stage != FilterRecord::kNone) setId(store.names, b.stage_events[r.stage]);
+      break;
+    case ExprField::kStageStart:
+      if (r.stage != FilterRecord::kNone) setNum(b.stage_starts[r.stage]);
+      break;
+    case ExprField::kStageEnd: if (r.stage != FilterRecord::kNone) setNum(b.stage_ends[r.stage]); break;
+    case ExprField::kStageDuration:
+      if (r.stage != FilterRecord::kNone) {
+        uint64_t s = b.stage_starts[r.stage], e = b.stage_ends[r.stage];
+        setNum(e >= s ? e - s : 0);
+      }
+      break;
+    case ExprField::kFuncName:
+      if (r.func != FilterRecord::kNone) setId(store.names, b.func_names[r.func]);
+      break;
+    case ExprField::kFuncStart: if (r.func != FilterRecord::kNone) setNum(b.func_starts[r.func]); break;
+    case ExprField::kFuncEnd: if (r.func != FilterRecord::kNone) setNum(b.func_ends[r.func]); break;
+    case ExprField::kFuncDuration:
+      if (r.func != FilterRecord::kNone) {
+        uint64_t s = b.func_starts[r.func], e = b.func_ends[r.func];
+        setNum(e >= s ? e - s : 0);
+      }
+      break;
+    case ExprField::kCntName:
+      if (r.cnt != FilterRecord::kNone) setId(store.names, b.cnt_names[r.cnt]);
+      break;
+    case ExprField::kCntUnit:
+      if (r.cnt != FilterRecord::kNone) setId(store.names, b.cnt_units[r.cnt]);
+      break;
+    case ExprField::kMeta: {
+      uint32_t key = metaKey();
+      uint32_t value = UINT32_MAX;
+      if (key == StringInterner::kInvalidId) break;
+      if (r.stage != FilterRecord::kNone) value = findMeta(store.stageMetadata(b, r.stage), key);
+      if (value == UINT32_MAX && r.inst != FilterRecord::kNone) {
+        value = findMeta(store.instMetadata(b, r.inst), key);
+      }
+      if (value == UINT32_MAX && r.func != FilterRecord::kNone) {
+        value = findMeta(store.funcMetadata(b, r.func), key);
+      }
+      if (value == UINT32_MAX && r.cnt != FilterRecord::kNone) {
+        value = findMeta(store.cntMetadata(b, r.cnt), key);
+      }
+      setId(store.strings, value);
+      break;
+    }
+    case ExprField::kInstMeta: {
+      uint32_t key = metaKey();
+      if (key != StringInterner::kInvalidId && r.inst != FilterRecord::kNone) {
+        setId(store.strings, findMeta(store.instMetadata(b, r.inst), key));
+      }
+      break;
+    }
+    case ExprField::kStageMeta: {
+      uint32_t key = metaKey();
+      if (key != StringInterner::kInvalidId && r.stage != FilterRecord::kNone) {
+        setId(store.strings, findMeta(store.stageMetadata(b, r.stage), key));
+      }
+      break;
+    }
+  }
+  return v;
+}
+
+template <typename T>
+bool applyOrder(ExprOp op, const T &a, const T &b) {
+  switch (op) {
+    case ExprOp::kEq: return a == b;
+    case ExprOp::kNe: return !(a == b);
+    case ExprOp::kLt: return a < b;
+    case ExprOp::kLe: return !(b < a);
+    case ExprOp::kGt: return b < a;
+    case ExprOp::kGe: return !(a < b);
+    default: return false;
+  }
+}
+
+bool compareValue(const ExprValue &v, ExprOp op, const ExprLiteral &literal) {
+  if (!v.present) {
+    return false;
+  }
+  if (v.numeric) {
+    // 编译时已保证数值字段只与数字比较
+    if (literal.is_integer) {
+      return applyOrder(op, v.num, literal.uint_value);
+    }
+    return applyOrder(op, static_cast<double>(v.num), literal.double_value);
+  }
+  const std::string &str = *v.str;
+  switch (op) {
+    case ExprOp::kEq: return str == literal.text;
+    case ExprOp::kNe: return str != literal.text;
+    case ExprOp::kContains: return str.find(literal.text) != std::string::npos;
+    case ExprOp::kNotContains: return str.find(literal.text) == std::string::npos;
+    default: break;
+  }
+  if (literal.is_number) {
+    // 字符串与数字比较大小：字符串能完整解析为数字时按数值比较，否则不通过
+    double value = 0;
+    return toDouble(str, value) && applyOrder(op, value, literal.double_value);
+  }
+  return applyOrder(op, str, literal.text);
+}
+
+bool evalPredicate(const Node &node, const ExprValue &v) {
+  if (!v.present) {
+    return false;
+  }
+  if (node.kind == Node::kCompare) {
+    return compareValue(v, node.op, node.literal);
+  }
+  if (v.numeric) {
+    return std::binary_search(node.num_set.begin(), node.num_set.end(), v.num);
+  }
+  return std::binary_search(node.str_set.begin(), node.str_set.end(), *v.str);
+}
+
+bool evalNode(const Node &node, const FilterRecord &r) {
+  switch (node.kind) {
+    case Node::kConst:
+      return node.value;
+    case Node::kAnd:
+      for (const auto &child : node.children) {
+        if (!evalNode(*child, r)) return false;
+      }
+      return true;
+    case Node::kOr:
+      for (const auto &child : node.children) {
+        if (evalNode(*child, r)) return true;
+      }
+      return false;
+    case Node::kNot:
+      return !evalNode(*node.children[0], r);
+    case Node::kCompare:
+    case Node::kIn: {
+      ExprValue v = fetch(node, r);
+      uint32_t id = v.id;
+      if (id != UINT32_MAX && id < node.id_cache.size() && node.id_cache[id] >= 0) {
+        return node.id_cache[id] != 0;
+      }
+      bool result = evalPredicate(node, v);
+      if (id != UINT32_MAX) {
+        if (id >= node.id_cache.size()) {
+          node.id_cache.resize(id + 1, -1);
+        }
+        node.id_cache[id] = result ? 1 : 0;
+      }
+      return result;
+    }
+  }
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// 语法分析
+// ---------------------------------------------------------------------------
+
+std::unique_ptr<Node> makeConst(bool value) {
+  auto node = std::make_unique<Node>();
+  node->kind = Node::kConst;
+  node->value = value;
+  return node;
+}
+
+class Parser {
+public:
+  Parser(const std::vector<Token> &tokens, std::string &error) : tokens_(tokens), error_(error) {}
+
+  std::unique_ptr<Node> parse() {
+    auto node = parseOr();
+    if (node && peek().type != Token::kEnd) {
+      fail("多余的内容 '" + peek().text + "'");
+      return nullptr;
+    }
+    return node;
+  }
+
+private:
+  // 比较运算的一侧：字段或字面量
+  struct Operand {
+    bool is_field = false;
+    ExprField field = ExprField::kDevice;
+    std::string meta_key;
+    ExprLiteral literal;
+  };
+
+  const Token &peek() const { return tokens_[pos_]; }
+  const Token &take() { return tokens_[pos_++]; }
+
+  bool accept(const char *punct) {
+    if (peek().type == Token::kPunct && peek().text == punct) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+
+  void fail(const std::string &message) {
+    if (error_.empty()) {
+      error_ = message + "（位置 " + std::to_string(peek().pos) + "）";
+    }
+  }
+
+  std::unique_ptr<Node> parseBinary(Node::Kind kind, const char *punct,
+                                    std::unique_ptr<Node> (Parser::*next)()) {
+    auto left = (this->*next)();
+    if (!left) return nullptr;
+    if (peek().type != Token::kPunct || peek().text != punct) {
+      return left;
+    }
+    auto node = std::make_unique<Node>();
+    node->kind = kind;
+    node->children.push_back(std::move(left));
+    while (accept(punct)) {
+      auto right = (this->*next)();
+      if (!right) return nullptr;
+      node->children.push_back(std::move(right));
+    }
+    return node;
+  }
+
+  std::unique_ptr<Node> parseOr() { return parseBinary(Node::kOr, "||", &Parser::parseAnd); }
+  std::unique_ptr<Node> parseAnd() { return parseBinary(Node::kAnd, "&&", &Parser::parseUnary); }
+
+  std::unique_ptr<Node> parseUnary() {
+    if (accept("!")) {
+      auto child = parseUnary();
+      if (!child) return nullptr;
+      auto node = std::make_unique<Node>();
+      node->kind = Node::kNot;
+      node->children.push_back(std::move(child));
+      return node;
+    }
+    if (accept("(")) {
+      auto node = parseOr();
+      if (!node) return nullptr;
+      if (!accept(")")) {
+        fail("缺少 ')'");
+        return nullptr;
+      }
+      return node;
+    }
+    if (peek().type == Token::kIdent && (peek().text == "true" || peek().text == "false")) {
+      return makeConst(take().text == "true");
+    }
+    return parseComparison();
+  }
+
+  bool parseLiteral(ExprLiteral &literal) {
+    const Token &token = peek();
+    if (token.type == Token::kString) {
+      literal.text = take().text;
+      return true;
+    }
+    if (token.type == Token::kNumber) {
+      if (!parseNumber(take().text, literal)) {
+        fail("非法的数字 '" + token.text + "'");
+        return false;
+      }
+      return true;
+    }
+    fail("需要字符串或数字");
+    return false;
+  }
+
+  bool parseOperand(Operand &operand) {
+    if (peek().type != Token::kIdent) {
+      return parseLiteral(operand.literal);
+    }
+    std::string name = take().text;
+    operand.is_field = true;
+
+    // meta.<key> / inst.meta.<key> / stage.meta.<key>，或者 meta["key"]
+    for (const char *prefix : {"inst.meta", "stage.meta", "meta"}) {
+      std::string p = prefix;
+      bool dotted = name.size() > p.size() + 1 && name.compare(0, p.size() + 1, p + ".") == 0;
+      if (name != p && !dotted) continue;
+      operand.field = p == "meta" ? ExprField::kMeta
+                    : p == "inst.meta" ? ExprField::kInstMeta : ExprField::kStageMeta;
+      if (dotted) {
+        operand.meta_key = name.substr(p.size() + 1);
+        return true;
+      }
+      if (!accept("[") || peek().type != Token::kString) {
+        fail(p + " 后需要 .key 或 [\"key\"]");
+        return false;
+      }
+      operand.meta_key = take().text;
+      if (!accept("]")) {
+        fail("缺少 ']'");
+        return false;
+      }
+      return true;
+    }
+
+    for (const auto &info : kExprFields) {
+      if (!isMetaField(info.field) && name == info.name) {
+        operand.field = info.field;
+        return true;
+      }
+    }
+    fail("未知字段 '" + name + "'");
+    return false;
+  }
+
+  std::unique_ptr<Node> parseComparison() {
+    Operand left;
+    if (!parseOperand(left)) return nullptr;
+
+    if (peek().type == Token::kIdent && peek().text == "in") {
+      take();
+      return parseIn(left);
+    }
+
+    static const std::pair<const char *, ExprOp> kOps[] = {
+        {"==", ExprOp::kEq}, {"!=", ExprOp::kNe}, {"~", ExprOp::kContains},
+        {"!~", ExprOp::kNotContains}, {"<", ExprOp::kLt}, {"<=", ExprOp::kLe},
+        {">", ExprOp::kGt}, {">=", ExprOp::kGe}};
+    ExprOp op = ExprOp::kEq;
+    bool found = false;
+    for (const auto &entry : kOps) {
+      if (accept(entry.first)) {
+        op = entry.second;
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      fail("需要比较运算符");
+      return nullptr;
+    }
+
+    Operand right;
+    if (!parseOperand(right)) return nullptr;
+    if (left.is_field && right.is_field) {
+      fail("不支持两个字段之间的比较");
+      return nullptr;
+    }
+
+    // 两侧都是字面量：编译期直接求值（常量折叠）
+    if (!left.is_field && !right.is_field) {
+      ExprValue v;
+      v.present = true;
+      v.str = &left.literal.text;
+      if (left.literal.is_number && right.literal.is_number) {
+        bool result = op == ExprOp::kContains || op == ExprOp::kNotContains
+                          ? compareValue(v, op, right.literal)
+                          : applyOrder(op, left.literal.double_value, right.literal.double_value);
+        return makeConst(result);
+      }
+      return makeConst(compareValue(v, op, right.literal));
+    }
+
+    // 字面量在左侧时交换两侧，子串匹配不可交换
+    if (!left.is_field) {
+      if (op == ExprOp::kContains || op == ExprOp::kNotContains) {
+        fail("'~' 左侧必须是字段");
+        return nullptr;
+      }
+      std::swap(left, right);
+      op = op == ExprOp::kLt ? ExprOp::kGt
+         : op == ExprOp::kLe ? ExprOp::kGe
+         : op == ExprOp::kGt ? ExprOp::kLt
+         : op == ExprOp::kGe ? ExprOp::kLe : op;
+    }
+
+    if (fieldInfo(left.field).numeric) {
+      if (!right.literal.is_number) {
+        fail(std::string("数值字段 ") + fieldInfo(left.field).name + " 只能与数字比较");
+        return nullptr;
+      }
+      if (op == ExprOp::kContains || op == ExprOp::kNotContains) {
+        fail("数值字段不支持 '~'");
+        return nullptr;
+      }
+    }
+
+    auto node = std::make_unique<Node>();
+    node->kind = Node::kCompare;
+    node->field = left.field;
+    node->meta_key = left.meta_key;
+    node->op = op;
+    node->literal = right.literal;
+    return node;
+  }
+
+  std::unique_ptr<Node> parseIn(const Operand &left) {
+    if (!left.is_field) {
+      fail("'in' 左侧必须是字段");
+      return nullptr;
+    }
+    if (!accept("[")) {
+      fail("'in' 后需要 '['");
+      return nullptr;
+    }
+    auto node = std::make_unique<Node>();
+    node->kind = Node::kIn;
+    node->field = left.field;
+    node->meta_key = left.meta_key;
+    bool numeric = fieldInfo(left.field).numeric;
+    if (!accept("]")) {
+      do {
+        ExprLiteral literal;
+        if (!parseLiteral(literal)) return nullptr;
+        if (numeric) {
+          if (!literal.is_integer) {
+            fail("数值字段的 in 列表只能包含非负整数");
+            return nullptr;
+          }
+          node->num_set.push_back(literal.uint_value);
+        } else {
+          node->str_set.push_back(literal.text);
+        }
+      } while (accept(","));
+      if (!accept("]")) {
+        fail("缺少 ']'");
+        return nullptr;
+      }
+    }
+    std::sort(node->num_set.begin(), node->num_set.end());
+    std::sort(node->str_set.begin(), node->str_set.end());
+    // 空列表恒为 false
+    if (node->num_set.empty() && node->str_set.empty()) {
+      return makeConst(false);
+    }
+    return node;
+  }
+
+  const std::vector<Token> &tokens_;
+  std::string &error_;
+  size_t pos_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// 化简：常量折叠、展平同类 &&/||、按代价排序子节点
+// ---------------------------------------------------------------------------
+
+int predicateCost(const Node &node) {
+  if (node.field == ExprField::kInstName || node.field == ExprField::kStageName ||
+      node.field == ExprField::kStageTitle || node.field == ExprField::kFuncName ||
+      node.field == ExprField::kCntName || node.field == ExprField::kCntUnit) {
+    return 1;  // 名称字段的结果按 ID 缓存，基本只是一次查表
+  }
+  if (fieldInfo(node.field).numeric) return 1;
+  if (isMetaField(node.field)) return 4;  // 需要扫描记录的 metadata 键值对
+  return node.kind == Node::kCompare &&
+         (node.op == ExprOp::kContains || node.op == ExprOp::kNotContains) ? 3 : 2;
+}
+
+std::unique_ptr<Node> simplify(std::unique_ptr<Node> node) {
+  switch (node->kind) {
+    case Node::kConst:
+      node->cost = 0;
+      return node;
+    case Node::kCompare:
+    case Node::kIn:
+      node->cost = predicateCost(*node);
+      return node;
+    case Node::kNot: {
+      auto child = simplify(std::move(node->children[0]));
+      if (child->kind == Node::kConst) {
+        return makeConst(!child->value);
+      }
+      if (child->kind == Node::kNot) {
+        return std::move(child->children[0]);
+      }
+      node->cost = child->cost;
+      node->children[0] = std::move(child);
+      return node;
+    }
+    case Node::kAnd:
+    case Node::kOr: {
+      // && 中 false 吸收一切、true 可以丢弃；|| 反之
+      bool absorbing = node->kind == Node::kOr;
+      std::vector<std::unique_ptr<Node>> children;
+      for (auto &child : node->children) {
+        auto simplified = simplify(std::move(child));
+        if (simplified->kind == Node::kConst) {
+          if (simplified->value == absorbing) {
+            return makeConst(absorbing);
+          }
+          continue;
+        }
+        if (simplified->kind == node->kind) {
+          for (auto &grandchild : simplified->children) {
+            children.push_back(std::move(grandchild));
+          }
+        } else {
+          children.push_back(std::move(simplified));
+        }
+      }
+      if (children.empty()) {
+        return makeConst(!absorbing);
+      }
+      if (children.size() == 1) {
+        return std::move(children[0]);
+      }
+      std::stable_sort(children.begin(), children.end(),
+                       [](const std::unique_ptr<Node> &a, const std::unique_ptr<Node> &b) {
+                         return a->cost < b->cost;
+                       });
+      node->cost = 0;
+      for (const auto &child : children) {
+        node->cost += child->cost;
+      }
+      node->children = std::move(children);
+      return node;
+    }
+  }
+  return node;
+}
+
+bool usesStageLevel(const Node &node) {
+  if (node.kind == Node::kCompare || node.kind == Node::kIn) {
+    return fieldInfo(node.field).stage_level;
+  }
+  for (const auto &child : node.children) {
+    if (usesStageLevel(*child)) return true;
+  }
+  return false;
+}
+
+void describeNode(const Node &node, std::ostringstream &out) {
+  auto describeField = [&out](const Node &n) {
+    if (isMetaField(n.field)) {
+      out << fieldInfo(n.field).name << "[\"" << n.meta_key << "\"]";
+    } else {
+      out << fieldInfo(n.field).name;
+    }
+  };
+  switch (node.kind) {
+    case Node::kConst:
+      out << (node.value ? "true" : "false");
+      break;
+    case Node::kAnd:
+    case Node::kOr:
+      out << "(";
+      for (size_t i = 0; i < node.children.size(); i++) {
+        if (i > 0) out << (node.kind == Node::kAnd ? " && " : " || ");
+        describeNode(*node.children[i], out);
+      }
+      out << ")";
+      break;
+    case Node::kNot:
+      out << "!(";
+      describeNode(*node.children[0], out);
+      out << ")";
+      break;
+    case Node::kCompare:
+      describeField(node);
+      out << " " << opText(node.op) << " ";
+      if (node.literal.is_number) out << node.literal.text;
+      else out << "\"" << node.literal.text << "\"";
+      break;
+    case Node::kIn: {
+      describeField(node);
+      out << " in [";
+      bool first = true;
+      for (uint64_t value : node.num_set) {
+        out << (first ? "" : ", ") << value;
+        first = false;
+      }
+      for (const auto &value : node.str_set) {
+        out << (first ? "" : ", ") << "\"" << value << "\"";
+        first = false;
+      }
+      out << "]";
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+FilterExpr::FilterExpr() : uses_stage_(false) {}
+
+FilterExpr::~FilterExpr() = default;
+
+bool FilterExpr::compile(const std::string &text, std::string &error) {
+  root_.reset();
+  uses_stage_ = false;
+  error.clear();
+
+  std::vector<Token> tokens;
+  if (!tokenize(text, tokens, error)) {
+    return false;
+  }
+  if (tokens.size() == 1) {
+    error = "表达式为空";
+    return false;
+  }
+  Parser parser(tokens, error);
+  auto node = parser.parse();
+  if (!node) {
+    return false;
+  }
+  node = simplify(std::move(node));
+  uses_stage_ = usesStageLevel(*node);
+  root_ = std::shared_ptr<const Node>(std::move(node));
+  return true;
+}
+
+bool FilterExpr::eval(const FilterRecord &record) const {
+  return !root_ || evalNode(*root_, record);
+}
+
+std::string FilterExpr::describe() const {
+  if (!root_) {
+    return "true";
+  }
+  std::ostringstream out;
+  describeNode(*root_, out);
+  return out.str();
+}
@@ -0,0 +1,93 @@
+#include "logger.hh"
+#include <iostream>
+#include <utility>
+
+Logger &Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger()
+    : level_(static_cast<int>(LogLevel::kInfo)), pending_bytes_(0), submitted_(0),
+      written_(0), stop_(false) {
+  worker_ = std::thread(&Logger::workerLoop, this);
+}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  worker_.join();
+}
+
+void Logger::write(LogLevel level, const std::string &message) {
+  bool to_stderr = level <= LogLevel::kWarn;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // 后台线程跟不上时让调用方等待，限制缓冲占用的内存
+    space_cv_.wait(lock, [this] { return pending_bytes_ < kMaxPendingBytes || stop_; });
+    if (pending_.empty() || pending_.back().to_stderr != to_stderr) {
+      pending_.push_back({to_stderr, std::string()});
+    }
+    auto &text = pending_.back().text;
+    text.append(message);
+    text.push_back('\n');
+    pending_bytes_ += message.size() + 1;
+    submitted_++;
+  }
+  work_cv_.notify_one();
+}
+
+void Logger::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t target = submitted_;
+  work_cv_.notify_one();
+  space_cv_.wait(lock, [this, target] { return written_ >= target; });
+}
+
+void Logger::workerLoop() {
+  std::vector<Chunk> chunks;
+  for (;;) {
+    uint64_t batch_end;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [this] { return !pending_.empty() || stop_; });
+      if (pending_.empty() && stop_) {
+        return;
+      }
+      chunks.swap(pending_);
+      pending_bytes_ = 0;
+      batch_end = submitted_;
+    }
+    space_cv_.notify_all();
+
+    for (const auto &chunk : chunks) {
+      std::ostream &out = chunk.to_stderr ? std::cerr : std::cout;
+      out.write(chunk.text.data(), static_cast<std::streamsize>(chunk.text.size()));
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    chunks.clear();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      written_ = batch_end;
+    }
+    space_cv_.notify_all();
+  }
+}
+
+bool Logger::parseLevel(const std::string &text, LogLevel &level) {
+  static const std::pair<const char *, LogLevel> kLevels[] = {
+      {"error", LogLevel::kError}, {"warn", LogLevel::kWarn}, {"info", LogLevel::kInfo},
+      {"debug", LogLevel::kDebug}, {"trace", LogLevel::kTrace}};
+  for (const auto &entry : kLevels) {
+    if (text == entry.first) {
+      level = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
@@ -1,6 +1,8 @@
 #include "perf_shower.hh"
+#include "logger.hh"
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <string>
@@ -9,6 +11,8 @@ int main(int argc, char* argv[]) {
   // 默认值
   const char* json_config = "data/show.json";
   std::string log_file_path;
+  int jobs = 0;
+  std::string backend;
 
   // 解析命令行参数
   for (int i = 1; i < argc; i++) {
@@ -26,12 +30,40 @@ int main(int argc, char* argv[]) {
         std::cerr << "错误: --log 需要指定文件路径" << std::endl;
         return 1;
       }
+    } else if (strcmp(argv[i], "--jobs") == 0) {
+      if (i + 1 < argc) {
+        jobs = std::atoi(argv[++i]);
+      } else {
+        std::cerr << "错误: --jobs 需要指定线程数" << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--backend") == 0) {
+      if (i + 1 < argc && (strcmp(argv[i + 1], "sdk") == 0 || strcmp(argv[i + 1], "stream") == 0)) {
+        backend = argv[++i];
+      } else {
+        std::cerr << "错误: --backend 需要指定 sdk 或 stream" << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--log-level") == 0) {
+      LogLevel level;
+      if (i + 1 < argc && Logger::parseLevel(argv[i + 1], level)) {
+        Logger::instance().setLevel(level);
+        i++;
+      } else {
+        std::cerr << "错误: --log-level 需要指定 error/warn/info/debug/trace 之一" << std::endl;
+        return 1;
+      }
     } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
       std::cout << "用法: " << argv[0] << " [选项]" << std::endl;
       std::cout << "选项:" << std::endl;
       std::cout << "  --json, -j <file>     JSON配置文件路径 (默认: data/show.json)" << std::endl;
       std::cout << "                        JSON 中必须包含 'filelist' 和 'output' 字段" << std::endl;
       std::cout << "  --log <file>          指定日志输出文件 (默认: 打印到控制台)" << std::endl;
+      std::cout << "  --jobs <n>            并行读取输入文件的线程数 (默认: JSON 中的 'jobs' 或 CPU 核数)" << std::endl;
+      std::cout << "  --backend <name>      追踪输出后端: sdk/stream (默认: JSON 中的 'backend' 或 sdk)" << std::endl;
+      std::cout << "                        stream 直接流式写入 TracePacket，不经过 SDK 缓冲区" << std::endl;
+      std::cout << "  --log-level <level>   日志级别: error/warn/info/debug/trace (默认: info)" << std::endl;
+      std::cout << "                        Release 构建中 debug/trace 日志被编译移除" << std::endl;
       std::cout << "  --help, -h             显示此帮助信息" << std::endl;
       std::cout << std::endl;
       std::cout << "示例:" << std::endl;
@@ -67,19 +99,22 @@ int main(int argc, char* argv[]) {
    int ret = 0;
    {
      PerfShower perf_shower;
+     perf_shower.setJobs(jobs);
+     perf_shower.setBackend(backend);
      perf_shower.init();
      
      std::string output_file = perf_shower.show(json_config);
      
      if (output_file.empty()) {
-       std::cerr << "错误：未能从 JSON 配置中获取输出文件路径" << std::endl;
+       LOG_ERROR("错误：未能从 JSON 配置中获取输出文件路径");
        ret = 1;
      } else {
        perf_shower.finish(output_file);
      }
    }
    
-   // 恢复 buffer
+   // 恢复 buffer 之前先把异步日志全部写出
+   Logger::instance().flush();
    if (!log_file_path.empty()) {
      std::cout.rdbuf(cout_buf);
      std::cerr.rdbuf(cerr_buf);
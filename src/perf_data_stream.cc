@@ -0,0 +1,371 @@
+#include "perf_data_stream.hh"
+#include "logger.hh"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+using namespace unified_perf_format;
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::FileInputStream;
+using google::protobuf::io::FileOutputStream;
+
+MappedFile::MappedFile() : data_(nullptr), size_(0), released_(0) {}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+
+bool MappedFile::open(const std::string &file_path) {
+  int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void *addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+  // 映射建立后即可关闭 fd，映射本身会保持文件引用
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<uint8_t *>(addr);
+  size_ = static_cast<size_t>(st.st_size);
+
+  // 仅为性能提示，内核不支持时忽略返回值
+  ::madvise(data_, size_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  ::madvise(data_, size_, MADV_HUGEPAGE);
+#endif
+  return true;
+}
+
+void MappedFile::releaseUpTo(size_t offset) {
+  constexpr size_t kReleaseGranularity = 64 << 20;
+  if (!data_ || offset <= released_ + kReleaseGranularity) {
+    return;
+  }
+  size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  size_t release_end = std::min(offset, size_) / page_size * page_size;
+  if (release_end > released_) {
+    ::madvise(data_ + released_, release_end - released_, MADV_DONTNEED);
+    released_ = release_end;
+  }
+}
+
+PerfDataStreamReader::PerfDataStreamReader(const std::string &file_path)
+    : file_path_(file_path), fd_(-1), data_(nullptr), size_(0), offset_(0),
+      has_error_(false), chunk_cnt_(0) {}
+
+PerfDataStreamReader::PerfDataStreamReader(const uint8_t *data, size_t size)
+    : file_path_("<mapped>"), fd_(-1), data_(data), size_(size), offset_(0),
+      has_error_(false), chunk_cnt_(0) {}
+
+PerfDataStreamReader::~PerfDataStreamReader() {
+  file_stream_.reset();
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+bool PerfDataStreamReader::open() {
+  if (data_) {
+    return openMapped();
+  }
+  fd_ = ::open(file_path_.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return false;
+  }
+  file_stream_ = std::make_unique<FileInputStream>(fd_);
+
+  // CodedInputStream 析构时会把未消费的缓冲归还给 file_stream_
+  CodedInputStream coded(file_stream_.get());
+  char magic[kPerfDataStreamMagicSize];
+  uint32_t version = 0;
+  if (!coded.ReadRaw(magic, kPerfDataStreamMagicSize) ||
+      std::memcmp(magic, kPerfDataStreamMagic, kPerfDataStreamMagicSize) != 0) {
+    return false;
+  }
+  if (!coded.ReadLittleEndian32(&version) || version > kPerfDataStreamVersion) {
+    LOG_ERROR("错误：文件 " << file_path_ << " 的分块格式版本不受支持: "
+              << version);
+    has_error_ = true;
+    return false;
+  }
+  return true;
+}
+
+bool PerfDataStreamReader::openMapped() {
+  if (size_ < kPerfDataStreamMagicSize + sizeof(uint32_t) ||
+      std::memcmp(data_, kPerfDataStreamMagic, kPerfDataStreamMagicSize) != 0) {
+    return false;
+  }
+  uint32_t version = 0;
+  CodedInputStream::ReadLittleEndian32FromArray(data_ + kPerfDataStreamMagicSize,
+                                                &version);
+  if (version > kPerfDataStreamVersion) {
+    LOG_ERROR("错误：分块格式版本不受支持: " << version);
+    has_error_ = true;
+    return false;
+  }
+  offset_ = kPerfDataStreamMagicSize + sizeof(uint32_t);
+  return true;
+}
+
+bool PerfDataStreamReader::nextMapped(UnifiedPerfData *perf_data) {
+  if (offset_ >= size_) {
+    return false;
+  }
+
+  // 长度字段最多 10 字节，只在剩余区域的头部解码
+  size_t remaining = size_ - offset_;
+  uint64_t chunk_size = 0;
+  int header_size = 0;
+  {
+    CodedInputStream header(data_ + offset_,
+                            static_cast<int>(std::min<size_t>(remaining, 10)));
+    if (!header.ReadVarint64(&chunk_size)) {
+      LOG_ERROR("错误：第 " << chunk_cnt_ << " 个 chunk 的长度字段不完整");
+      has_error_ = true;
+      return false;
+    }
+    header_size = header.CurrentPosition();
+  }
+  if (chunk_size > static_cast<uint64_t>(INT_MAX) ||
+      chunk_size > remaining - header_size) {
+    LOG_ERROR("错误：第 " << chunk_cnt_ << " 个 chunk 长度非法或文件被截断 ("
+              << chunk_size << " 字节)");
+    has_error_ = true;
+    return false;
+  }
+  offset_ += header_size;
+
+  // 直接在映射区域上解析，不经过任何中间缓冲
+  // 注意：proto3 的 string 字段在开源 protobuf 中只能是 std::string，无法别名映射内存，
+  // 字符串内容仍会被拷贝一次
+  ArrayInputStream array_stream(data_ + offset_, static_cast<int>(chunk_size));
+  CodedInputStream coded(&array_stream);
+  coded.SetTotalBytesLimit(INT_MAX);
+  if (!perf_data->ParseFromCodedStream(&coded) || !coded.ConsumedEntireMessage()) {
+    LOG_ERROR("错误：第 " << chunk_cnt_ << " 个 chunk 解析失败");
+    has_error_ = true;
+    return false;
+  }
+  offset_ += chunk_size;
+  chunk_cnt_++;
+  return true;
+}
+
+bool PerfDataStreamReader::next(UnifiedPerfData *perf_data) {
+  if (has_error_) {
+    return false;
+  }
+  if (data_) {
+    return nextMapped(perf_data);
+  }
+  if (!file_stream_) {
+    return false;
+  }
+
+  // 每个 chunk 使用独立的 CodedInputStream，避免触发整体字节数上限
+  CodedInputStream coded(file_stream_.get());
+  uint64_t chunk_size = 0;
+  if (!coded.ReadVarint64(&chunk_size)) {
+    // 一个字节都没读到说明正常到达文件末尾，否则是长度字段被截断
+    if (coded.CurrentPosition() != 0) {
+      LOG_ERROR("错误：文件 " << file_path_ << " 第 " << chunk_cnt_
+                << " 个 chunk 的长度字段不完整");
+      has_error_ = true;
+    }
+    return false;
+  }
+  if (chunk_size > static_cast<uint64_t>(INT_MAX)) {
+    LOG_ERROR("错误：文件 " << file_path_ << " 第 " << chunk_cnt_
+              << " 个 chunk 过大 (" << chunk_size << " 字节)");
+    has_error_ = true;
+    return false;
+  }
+
+  coded.SetTotalBytesLimit(INT_MAX);
+  auto limit = coded.PushLimit(static_cast<int>(chunk_size));
+  if (!perf_data->ParseFromCodedStream(&coded) ||
+      !coded.ConsumedEntireMessage() ||
+      coded.BytesUntilLimit() != 0) {
+    LOG_ERROR("错误：文件 " << file_path_ << " 第 " << chunk_cnt_
+              << " 个 chunk 解析失败");
+    has_error_ = true;
+    return false;
+  }
+  coded.PopLimit(limit);
+  chunk_cnt_++;
+  return true;
+}
+
+PerfDataStreamWriter::PerfDataStreamWriter() : fd_(-1) {}
+
+PerfDataStreamWriter::~PerfDataStreamWriter() { close(); }
+
+bool PerfDataStreamWriter::open(const std::string &file_path) {
+  fd_ = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    LOG_ERROR("错误：无法创建文件 " << file_path);
+    return false;
+  }
+  file_stream_ = std::make_unique<FileOutputStream>(fd_);
+
+  CodedOutputStream coded(file_stream_.get());
+  coded.WriteRaw(kPerfDataStreamMagic, kPerfDataStreamMagicSize);
+  coded.WriteLittleEndian32(kPerfDataStreamVersion);
+  return !coded.HadError();
+}
+
+bool PerfDataStreamWriter::write(const UnifiedPerfData &perf_data) {
+  if (!file_stream_) {
+    return false;
+  }
+  size_t chunk_size = perf_data.ByteSizeLong();
+  if (chunk_size > static_cast<size_t>(INT_MAX)) {
+    LOG_ERROR("错误：数据块过大 (" << chunk_size
+              << " 字节)，请拆分为多个 chunk 写入");
+    return false;
+  }
+
+  CodedOutputStream coded(file_stream_.get());
+  coded.WriteVarint64(chunk_size);
+  perf_data.SerializeWithCachedSizes(&coded);
+  return !coded.HadError();
+}
+
+bool PerfDataStreamWriter::close() {
+  bool ok = true;
+  if (file_stream_) {
+    ok = file_stream_->Close();
+    file_stream_.reset();
+    fd_ = -1;
+  } else if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  return ok;
+}
+
+namespace {
+
+// 生产端的字符串表：相同的字符串只分配一个 ID，ID 0 保留给空字符串
+class StringTableBuilder {
+public:
+  explicit StringTableBuilder(google::protobuf::RepeatedPtrField<std::string> *table)
+      : table_(table) {
+    if (table_->empty()) {
+      table_->Add();
+    }
+    for (int id = 1; id < table_->size(); id++) {
+      ids_.emplace(table_->Get(id), static_cast<uint32_t>(id));
+    }
+  }
+
+  uint32_t id(const std::string &text) {
+    if (text.empty()) {
+      return 0;
+    }
+    auto it = ids_.find(text);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    uint32_t new_id = static_cast<uint32_t>(table_->size());
+    *table_->Add() = text;
+    ids_.emplace(text, new_id);
+    return new_id;
+  }
+
+  template <class Record>
+  void encodeMetadata(Record *record) {
+    for (const auto &pair : record->metadata()) {
+      record->add_metadata_ids(id(pair.first));
+      record->add_metadata_ids(id(pair.second));
+    }
+    record->clear_metadata();
+  }
+
+private:
+  google::protobuf::RepeatedPtrField<std::string> *table_;
+  std::unordered_map<std::string, uint32_t> ids_;
+};
+
+}  // namespace
+
+void encodeStringTable(UnifiedPerfData *perf_data) {
+  StringTableBuilder table(perf_data->mutable_string_table());
+  if (perf_data->has_instructions()) {
+    for (auto &inst : *perf_data->mutable_instructions()->mutable_instructions()) {
+      inst.set_name_id(table.id(inst.name()));
+      inst.clear_name();
+      table.encodeMetadata(&inst);
+      for (auto &stage : *inst.mutable_stages()) {
+        stage.set_name_id(table.id(stage.name()));
+        stage.set_show_title_id(table.id(stage.show_title()));
+        stage.clear_name();
+        stage.clear_show_title();
+        table.encodeMetadata(&stage);
+      }
+    }
+  } else if (perf_data->has_functions()) {
+    for (auto &func : *perf_data->mutable_functions()->mutable_functions()) {
+      func.set_name_id(table.id(func.name()));
+      func.clear_name();
+      table.encodeMetadata(&func);
+    }
+  } else if (perf_data->has_counters()) {
+    for (auto &cnt : *perf_data->mutable_counters()->mutable_counters()) {
+      cnt.set_name_id(table.id(cnt.name()));
+      cnt.set_unit_id(table.id(cnt.unit()));
+      cnt.clear_name();
+      cnt.clear_unit();
+      table.encodeMetadata(&cnt);
+    }
+  }
+}
+
+void packCounterSamples(UnifiedPerfData *perf_data, bool single_precision) {
+  if (!perf_data->has_counters()) {
+    return;
+  }
+  for (auto &cnt : *perf_data->mutable_counters()->mutable_counters()) {
+    if (cnt.sample_time_deltas_size() > 0) {
+      continue;
+    }
+    int sample_count = cnt.values_size();
+    cnt.mutable_sample_time_deltas()->Reserve(sample_count);
+    if (single_precision) {
+      cnt.mutable_sample_values_f32()->Reserve(sample_count);
+    } else {
+      cnt.mutable_sample_values()->Reserve(sample_count);
+    }
+    uint64_t prev_timestamp = 0;
+    for (const auto &value : cnt.values()) {
+      cnt.add_sample_time_deltas(static_cast<int64_t>(value.timestamp() - prev_timestamp));
+      prev_timestamp = value.timestamp();
+      if (single_precision) {
+        cnt.add_sample_values_f32(static_cast<float>(value.value()));
+      } else {
+        cnt.add_sample_values(value.value());
+      }
+    }
+    cnt.clear_values();
+  }
+}
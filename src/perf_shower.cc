@@ -1,9 +1,15 @@
 #include "perf_shower.hh"
+#include "logger.hh"
+#include "perf_data_stream.hh"
+#include "radix_sort.hh"
+#include "thread_pool.hh"
 #include "unified_perf_format.pb.h"
 #include "../lib/json.hpp"
 #include <algorithm>
 #include <cassert>
+#include <climits>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -22,17 +28,17 @@ using google::protobuf::io::FileInputStream;
 using google::protobuf::io::CodedInputStream;
 using json = nlohmann::json;
 
-// 注意：已不再使用带长度前缀的读取方式
-// 现在使用 UnifiedPerfDataContainer 容器消息，可以直接用 ParseFromIstream 读取
-
-typedef const google::protobuf::Map<std::string, std::string> MetadataMap;
+// 输入文件支持三种格式，按以下顺序尝试：
+// 1. 分块流式格式（见 perf_data_stream.hh），逐 chunk 解析，不受 2GB 限制
+// 2. UnifiedPerfDataContainer 容器消息（旧格式）
+// 3. 单个 UnifiedPerfData 消息（向后兼容）
 
 RoleConfig PerfShower::loadRoleConfig(const std::string &role_path) {
   RoleConfig config;
   
   std::ifstream file(role_path);
   if (!file.is_open()) {
-    std::cerr << "警告：无法打开 role.json 文件 " << role_path << std::endl;
+    LOG_WARN("警告：无法打开 role.json 文件 " << role_path);
     return config;
   }
 
@@ -40,7 +46,7 @@ RoleConfig PerfShower::loadRoleConfig(const std::string &role_path) {
   try {
     file >> j;
   } catch (const json::parse_error &e) {
-    std::cerr << "警告：role.json 解析失败: " << e.what() << std::endl;
+    LOG_WARN("警告：role.json 解析失败: " << e.what());
     return config;
   }
 
@@ -58,7 +64,7 @@ RoleConfig PerfShower::loadRoleConfig(const std::string &role_path) {
     }
   }
 
-  std::cout << "加载 role 配置: " << config.numThread << " 个线程" << std::endl;
+  LOG_INFO("加载 role 配置: " << config.numThread << " 个线程");
   return config;
 }
 
@@ -70,7 +76,8 @@ std::string PerfShower::getRoleName(uint32_t thread_id) const {
   return "";
 }
 
-PerfShower::PerfShower() : initialized_(false) {
+PerfShower::PerfShower()
+    : initialized_(false), jobs_(0), buf_size_kb_(kDefaultBufferSizeKb), next_flow_id_(1) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 }
 
@@ -78,7 +85,7 @@ PerfShower::~PerfShower() {}
 
 void PerfShower::init(int buf_size_kb) {
   if (!initialized_) {
-    perfetto_wrapper_.start(buf_size_kb);
+    buf_size_kb_ = buf_size_kb > 0 ? buf_size_kb : kDefaultBufferSizeKb;
     initialized_ = true;
   }
 }
@@ -91,195 +98,647 @@ void PerfShower::finish(const std::string &output_path) {
   }
 }
 
+// 辅助函数：instruction 的第 stage_index 个（过滤后）stage 需要附加的 instruction metadata
+// 去重模式下只有第一个 stage 携带，其余 stage 使用空表
+static MetadataSpan instMetadataForStage(const TraceStore &store, const TraceBlock &block,
+                                         uint32_t inst, size_t stage_index,
+                                         bool dedup_inst_metadata) {
+  if (dedup_inst_metadata && stage_index != 0) {
+    return MetadataSpan();
+  }
+  return store.instMetadata(block, inst);
+}
+
 void PerfShower::processInstruction(
-    const unified_perf_format::Instruction &inst,
-    perfetto::Track &parent_track) {
+    const TraceStore &store, const TraceBlock &block, uint32_t inst,
+    perfetto::Track &parent_track,
+    bool dedup_inst_metadata,
+    const MetadataKeyFilter *key_filter) {
   // 创建 instruction 轨道
-  std::string track_name = "inst_" + std::to_string(inst.thread_id()) + "_" +
-                           std::to_string(inst.global_seq_num());
+  std::string track_name = "inst_" + std::to_string(block.inst_threads[inst]) + "_" +
+                           std::to_string(block.inst_seqs[inst]);
 
   auto track = perfetto_wrapper_.createNamedTrack(
-      track_name, inst.name(), parent_track, inst.global_seq_num(), true);
+      track_name, store.names.str(block.inst_names[inst]), parent_track, block.inst_seqs[inst],
+      true);
 
   // 处理所有 stages
-  for (const auto &stage : inst.stages()) {
-    assert(stage.start_time() <= stage.end_time());
-    // show_title 作为 event 名字，如果为空则使用 name
-    std::string event_name = stage.show_title().empty() ? stage.name() : stage.show_title();
-    perfetto_wrapper_.addTraceEvent(event_name, *track, stage.start_time(),
-                                    stage.end_time(), inst.metadata(),
-                                    stage.metadata());
+  for (uint32_t s = block.inst_stage_begin[inst]; s < block.inst_stage_begin[inst + 1]; s++) {
+    assert(block.stage_starts[s] <= block.stage_ends[s]);
+    // show_title 作为 event 名字，如果为空则使用 name（读取时已经按此规则选好）
+    perfetto_wrapper_.addTraceEvent(
+        store.names.str(block.stage_events[s]), *track, block.stage_starts[s], block.stage_ends[s],
+        {instMetadataForStage(store, block, inst, s - block.inst_stage_begin[inst],
+                              dedup_inst_metadata),
+         store.stageMetadata(block, s)},
+        key_filter);
   }
 }
 
-// 辅助函数：检查两个 stage 是否时间重叠
-static bool stagesOverlap(const unified_perf_format::Stage &a,
-                          const unified_perf_format::Stage &b) {
-  // 两个阶段重叠当且仅当：a.start < b.end && b.start < a.end
-  return a.start_time() < b.end_time() && b.start_time() < a.end_time();
-}
+namespace {
 
-void PerfShower::processPipMode(
-    const unified_perf_format::BatchInstruction &batch_instruction,
-    perfetto::Track &parent_track) {
-  // 定义 track 分配策略
-  enum TrackPolicy { SMALL_FIRST, LAST_STEP_FIRST };
-  TrackPolicy track_policy = SMALL_FIRST; // 默认使用 SMALL_FIRST 策略
-
-  // 定义包含 stage、metadata 和 thread_id 的结构
-  struct StageWithThread {
-    const unified_perf_format::Stage* stage;
-    const MetadataMap* metadata;
-    uint32_t thread_id;
-  };
+// pipe 模式中待分配 lane 的 stage
+struct PipeStage {
+  uint32_t stage;       // TraceBlock 中的 stage 下标
+  uint32_t inst_index;  // 所属指令在 FilteredInstructions::insts 中的下标
+};
+
+typedef std::pair<uint64_t, PipeStage> KeyedStage;  // (start_time, stage)
+
+// pipe 模式中同名 stage 的分组及其 lane 布局
+struct PipeGroup {
+  uint32_t name_id;
+  std::vector<KeyedStage> stages;   // 排序后按 start_time 升序
+  uint32_t lane_count = 0;
+  std::vector<size_t> lane_begin;   // lane i 的 stage 为 lane_stages[lane_begin[i], lane_begin[i + 1])
+  std::vector<uint32_t> lane_stages;  // stages 的下标，按 lane 连续存放
+};
+
+// 并行排序的阈值：stage 总数较少时线程调度的开销大于收益
+constexpr size_t kParallelPipeStages = 1 << 15;
+
+// assignLanes 中因达到 lane 数上限而未分配的区间
+constexpr uint32_t kNoLane = UINT32_MAX;
 
-  std::map<std::string, std::vector<StageWithThread>> stage_map;
+/**
+ * 驻留 ID -> 分组下标的开放寻址哈希表（线性探测，负载不超过 1/2）
+ */
+class IdGroupTable {
+public:
+  IdGroupTable() : slots_(16, Slot{kEmptyId, 0}), size_(0) {}
 
-  // 将所有 stage 按照 name 分组，同时记录每个 stage 对应的 thread_id
-  for (const auto &inst : batch_instruction.instructions()) {
-    uint32_t thread_id = inst.thread_id();
-    for (const auto &st : inst.stages()) {
-      assert(st.start_time() <= st.end_time());
-      // 创建 StageWithThread 结构体并添加到 stage_map
-      StageWithThread swt;
-      swt.stage = &st;
-      swt.metadata = &inst.metadata();
-      swt.thread_id = thread_id;
-      stage_map[st.name()].push_back(swt);
+  /**
+   * 查找 id 对应的分组下标，不存在时插入 next_group
+   * @return 分组下标
+   */
+  uint32_t findOrInsert(uint32_t id, uint32_t next_group) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+      grow();
+    }
+    size_t mask = slots_.size() - 1;
+    for (size_t pos = hash(id) & mask;; pos = (pos + 1) & mask) {
+      if (slots_[pos].id == id) {
+        return slots_[pos].group;
+      }
+      if (slots_[pos].id == kEmptyId) {
+        slots_[pos] = Slot{id, next_group};
+        size_++;
+        return next_group;
+      }
     }
   }
 
-  // 将每个 name 的 stage 按照 start_time 排序
-  for (auto &[name, stages] : stage_map) {
-    std::sort(
-        stages.begin(), stages.end(),
-        [](const StageWithThread &a,
-           const StageWithThread &b) { return a.stage->start_time() < b.stage->start_time(); });
+private:
+  struct Slot {
+    uint32_t id;
+    uint32_t group;
+  };
+  static constexpr uint32_t kEmptyId = StringInterner::kInvalidId;
+
+  static size_t hash(uint32_t id) { return static_cast<uint32_t>(id * 0x9E3779B1u); }
+
+  void grow() {
+    std::vector<Slot> old_slots(slots_.size() * 2, Slot{kEmptyId, 0});
+    old_slots.swap(slots_);
+    size_t mask = slots_.size() - 1;
+    for (const auto &slot : old_slots) {
+      if (slot.id == kEmptyId) continue;
+      size_t pos = hash(slot.id) & mask;
+      while (slots_[pos].id != kEmptyId) {
+        pos = (pos + 1) & mask;
+      }
+      slots_[pos] = slot;
+    }
   }
 
-  // stage_map = {
-  //   "Life" : [stage1, stage2, stage3],
-  //   "Twice" : [stage4, stage5, stage6],
-  // }
-  int track_rank_id = 0;
+  std::vector<Slot> slots_;
+  size_t size_;
+};
+
+/**
+ * 一批指令（一个数据块在一个视图中的过滤结果）之间由 parent_seq_num 给出的依赖边
+ * 先把 global_seq_num 放入开放寻址哈希表（线性探测，负载不超过 1/2）得到批内下标，
+ * 每条边连接父指令的最后一个 stage 和子指令的第一个 stage，按 CSR 形式存放。
+ * trace processor 按时间顺序处理 flow，因此开始时间较早的一端写为 flow_ids，较晚的一端写为
+ * terminating_flow_ids；两端开始时间相同时都写为 flow_ids，与输出顺序无关。
+ * 时间和内存都与指令数加边数成线性关系；父指令不在同一批中的依赖不会连线。
+ */
+class InstDependencyFlows {
+public:
+  /**
+   * 为 filtered 中的指令建立依赖边
+   * @param block 过滤结果所属的数据块
+   * @param filtered 过滤后的指令视图
+   * @param first_flow_id 第一条边的 flow id，其余边的 id 依次加 1
+   * @return 边数
+   */
+  size_t build(const TraceBlock &block, const FilteredInstructions &filtered,
+               uint64_t first_flow_id) {
+    edge_count_ = 0;
+    size_t n = filtered.insts.size();
+    size_t parent_refs = 0;
+    for (const auto &entry : filtered.insts) {
+      parent_refs += block.inst_parent_begin[entry.inst + 1] - block.inst_parent_begin[entry.inst];
+    }
+    if (parent_refs == 0) {
+      return 0;
+    }
+
+    size_t capacity = 16;
+    while (capacity < n * 2) {
+      capacity *= 2;
+    }
+    slots_.assign(capacity, Slot{0, kNotFound});
+    for (size_t k = 0; k < n; k++) {
+      if (filtered.insts[k].stage_count != 0) {
+        insert(block.inst_seqs[filtered.insts[k].inst], static_cast<uint32_t>(k));
+      }
+    }
 
-  for (auto &stage_it : stage_map) {
-    std::vector<std::queue<StageWithThread>>
-        track_stage_queue_vec;
-    int last_step_idx = 0;
-
-    for (auto stage_with_thread : stage_it.second) {
-      bool found_track = false;
-      // 找到一个不重叠的track
-      if (track_policy == SMALL_FIRST) {
-        for (auto &track : track_stage_queue_vec) {
-          if (!track.empty() &&
-              !stagesOverlap(*track.back().stage, *stage_with_thread.stage)) {
-            track.push(stage_with_thread);
-            found_track = true;
-            break;
+    // 两遍扫描：第一遍统计每个端点列表的长度，前缀和后第二遍填入 flow id
+    begin_.assign(n * kListsPerInst + 1, 0);
+    size_t edge = 0;
+    for (int pass = 0; pass < 2; pass++) {
+      for (size_t k = 0; k < n; k++) {
+        const auto &entry = filtered.insts[k];
+        if (entry.stage_count == 0) continue;
+        uint64_t child_start = block.stage_starts[filtered.stages[entry.stage_begin]];
+        for (uint32_t p = block.inst_parent_begin[entry.inst];
+             p < block.inst_parent_begin[entry.inst + 1]; p++) {
+          uint32_t parent = find(block.parent_seqs[p]);
+          if (parent == kNotFound || parent == k) continue;
+          const auto &parent_entry = filtered.insts[parent];
+          uint64_t parent_start = block.stage_starts[
+              filtered.stages[parent_entry.stage_begin + parent_entry.stage_count - 1]];
+          size_t parent_list = parent * kListsPerInst +
+                               (parent_start <= child_start ? kLastOutgoing : kLastTerminating);
+          size_t child_list = k * kListsPerInst +
+                              (child_start <= parent_start ? kFirstOutgoing : kFirstTerminating);
+          if (pass == 0) {
+            begin_[parent_list + 1]++;
+            begin_[child_list + 1]++;
+          } else {
+            ids_[fill_pos_[parent_list]++] = first_flow_id + edge;
+            ids_[fill_pos_[child_list]++] = first_flow_id + edge;
+            edge++;
           }
         }
-      } else if (track_policy == LAST_STEP_FIRST) {
-        int cnt = 0;
-        for (int idx = last_step_idx; cnt < track_stage_queue_vec.size();
-             idx = (idx + 1) % track_stage_queue_vec.size()) {
-          if (!track_stage_queue_vec[idx].empty() &&
-              !stagesOverlap(*track_stage_queue_vec[idx].back().stage,
-                             *stage_with_thread.stage)) {
-            track_stage_queue_vec[idx].push(stage_with_thread);
-            found_track = true;
-            last_step_idx = idx;
-            break;
-          }
-          cnt++;
+      }
+      if (pass == 0) {
+        for (size_t i = 0; i + 1 < begin_.size(); i++) {
+          begin_[i + 1] += begin_[i];
         }
+        if (begin_.back() == 0) {
+          return 0;
+        }
+        ids_.resize(begin_.back());
+        fill_pos_.assign(begin_.begin(), begin_.end() - 1);
       }
-      // 如果没找到，创建一个新track
-      if (!found_track) {
-        track_stage_queue_vec.push_back(
-            std::queue<StageWithThread>());
-        track_stage_queue_vec.back().push(stage_with_thread);
-        last_step_idx = track_stage_queue_vec.size() - 1;
+    }
+    edge_count_ = edge;
+    return edge_count_;
+  }
+
+  /**
+   * 第 k 条指令的某个（过滤后）stage 上的 flow
+   * @param first 是否为该指令的第一个 stage
+   * @param last 是否为该指令的最后一个 stage
+   */
+  EventFlows stageFlows(size_t k, bool first, bool last) const {
+    EventFlows flows;
+    if (edge_count_ == 0 || (!first && !last)) {
+      return flows;
+    }
+    // 只有一个 stage 时两端的列表相邻，合并为一段
+    size_t base = k * kListsPerInst;
+    size_t out_begin = begin_[base + (first ? kFirstOutgoing : kLastOutgoing)];
+    size_t out_end = begin_[base + (last ? kLastOutgoing : kFirstOutgoing) + 1];
+    size_t term_begin = begin_[base + (first ? kFirstTerminating : kLastTerminating)];
+    size_t term_end = begin_[base + (last ? kLastTerminating : kFirstTerminating) + 1];
+    flows.outgoing = ids_.data() + out_begin;
+    flows.outgoing_count = out_end - out_begin;
+    flows.terminating = ids_.data() + term_begin;
+    flows.terminating_count = term_end - term_begin;
+    return flows;
+  }
+
+private:
+  struct Slot {
+    uint64_t seq;
+    uint32_t index;
+  };
+  static constexpr uint32_t kNotFound = UINT32_MAX;
+
+  // 每条指令的四个端点列表，出发与结束的列表分别相邻存放
+  enum { kFirstOutgoing, kLastOutgoing, kFirstTerminating, kLastTerminating, kListsPerInst };
+
+  size_t slotOf(uint64_t seq) const {
+    return static_cast<size_t>((seq * 0x9E3779B97F4A7C15ull) >> 32) & (slots_.size() - 1);
+  }
+
+  // global_seq_num 重复时保留第一条指令
+  void insert(uint64_t seq, uint32_t index) {
+    size_t mask = slots_.size() - 1;
+    for (size_t pos = slotOf(seq);; pos = (pos + 1) & mask) {
+      if (slots_[pos].index == kNotFound) {
+        slots_[pos] = Slot{seq, index};
+        return;
+      }
+      if (slots_[pos].seq == seq) {
+        return;
+      }
+    }
+  }
+
+  uint32_t find(uint64_t seq) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t pos = slotOf(seq);; pos = (pos + 1) & mask) {
+      if (slots_[pos].index == kNotFound || slots_[pos].seq == seq) {
+        return slots_[pos].index;
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::vector<size_t> begin_;     // 列表 i 为 ids_[begin_[i], begin_[i + 1])
+  std::vector<size_t> fill_pos_;
+  std::vector<uint64_t> ids_;
+  size_t edge_count_ = 0;
+};
+
+/**
+ * 区间划分：把按开始时间排序的区间分配到互不重叠的 lane 上
+ * 正在占用的 lane 按结束时间放在最小堆中，处理每个区间前先把已经结束的 lane 移入空闲集合，
+ * 再按策略从空闲集合中选择 lane，没有空闲 lane 时才新建，因此 lane 数最少（等于最大重叠数）
+ *   - kSmallFirst：选编号最小的空闲 lane
+ *   - kLastStepFirst：从上一次使用的 lane 开始按编号循环查找第一个空闲 lane
+ * busy_until 给出之前已经分配的 lane 及其最后一个区间的结束时间，新区间不早于该时间时才能复用；
+ * max_lanes 非 0 时 lane 总数不超过该上限，没有空闲 lane 且已达上限的区间不分配 lane（记为 kNoLane）
+ * 复杂度 O(n log k)，k 为 lane 数
+ * @param items 按开始时间排序的 (开始时间, 值) 数组
+ * @param policy 分配策略
+ * @param max_lanes lane 数上限，0 表示不限制
+ * @param busy_until 已有 lane 的占用结束时间，lane 编号为下标
+ * @param end_time 由值求结束时间的函数
+ * @param lane_of 输出每个区间的 lane 编号
+ * @return lane 数
+ */
+template <class T, class EndTime>
+uint32_t assignLanes(const std::vector<std::pair<uint64_t, T>> &items, LanePolicy policy,
+                     uint32_t max_lanes, const std::vector<uint64_t> &busy_until,
+                     EndTime end_time, std::vector<uint32_t> &lane_of) {
+  typedef std::pair<uint64_t, uint32_t> LaneEnd;  // (结束时间, lane)
+  std::priority_queue<LaneEnd, std::vector<LaneEnd>, std::greater<LaneEnd>> busy;
+  std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> free_lanes;
+  std::set<uint32_t> free_ring;  // kLastStepFirst 需要按编号查找后继
+  uint32_t lane_count = static_cast<uint32_t>(busy_until.size());
+  uint32_t last_lane = 0;
+  for (uint32_t lane = 0; lane < lane_count; lane++) {
+    busy.emplace(busy_until[lane], lane);
+  }
+
+  lane_of.resize(items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    uint64_t start = items[i].first;
+    uint64_t end = end_time(items[i].second);
+    assert(start <= end);
+    // 结束时间不晚于当前区间开始时间的 lane 不再与之后的区间重叠
+    while (!busy.empty() && busy.top().first <= start) {
+      if (policy == LanePolicy::kSmallFirst) {
+        free_lanes.push(busy.top().second);
+      } else {
+        free_ring.insert(busy.top().second);
+      }
+      busy.pop();
+    }
+
+    bool no_free_lane = policy == LanePolicy::kSmallFirst ? free_lanes.empty() : free_ring.empty();
+    if (no_free_lane && max_lanes != 0 && lane_count >= max_lanes) {
+      lane_of[i] = kNoLane;
+      continue;
+    }
+
+    uint32_t lane;
+    if (policy == LanePolicy::kSmallFirst) {
+      if (!free_lanes.empty()) {
+        lane = free_lanes.top();
+        free_lanes.pop();
+      } else {
+        lane = lane_count++;
+      }
+    } else {
+      if (!free_ring.empty()) {
+        auto it = free_ring.lower_bound(last_lane);
+        if (it == free_ring.end()) {
+          it = free_ring.begin();
+        }
+        lane = *it;
+        free_ring.erase(it);
+      } else {
+        lane = lane_count++;
+      }
+      last_lane = lane;
+    }
+    lane_of[i] = lane;
+    busy.emplace(end, lane);
+  }
+  return lane_count;
+}
+
+/**
+ * 对一个分组按 start_time 排序并分配 lane，各分组之间互不依赖，可以并行执行
+ * @param stage_ends 数据块的 stage 结束时间列
+ */
+void layoutPipeGroup(PipeGroup &group, LanePolicy policy, const std::vector<uint64_t> &stage_ends) {
+  std::vector<KeyedStage> buffer;
+  radixSortByKey(group.stages, buffer);
+
+  std::vector<uint32_t> lane_of;
+  group.lane_count = assignLanes(group.stages, policy, 0, {},
+                                 [&](const PipeStage &stage) { return stage_ends[stage.stage]; },
+                                 lane_of);
+
+  // 按 lane 把 stage 放入一个连续数组（计数排序，lane 内保持 start_time 顺序）
+  group.lane_begin.assign(group.lane_count + 1, 0);
+  for (uint32_t lane : lane_of) {
+    group.lane_begin[lane + 1]++;
+  }
+  for (uint32_t lane = 0; lane < group.lane_count; lane++) {
+    group.lane_begin[lane + 1] += group.lane_begin[lane];
+  }
+  group.lane_stages.resize(group.stages.size());
+  std::vector<size_t> fill_pos(group.lane_begin.begin(), group.lane_begin.end() - 1);
+  for (size_t i = 0; i < group.stages.size(); i++) {
+    group.lane_stages[fill_pos[lane_of[i]]++] = static_cast<uint32_t>(i);
+  }
+}
+
+}  // namespace
+
+void PerfShower::processPipMode(
+    const TraceStore &store, const TraceBlock &block,
+    const FilteredInstructions &filtered,
+    perfetto::Track &parent_track,
+    const ViewConfig &view_config) {
+  const MetadataKeyFilter *key_filter =
+      view_config.metadata_filter.enabled() ? &view_config.metadata_filter : nullptr;
+  InstDependencyFlows dependencies;
+  if (view_config.dependency_flows) {
+    next_flow_id_ += dependencies.build(block, filtered, next_flow_id_);
+  }
+
+  // 将所有 stage 按照 name 的驻留 ID 分组
+  std::vector<PipeGroup> groups;
+  IdGroupTable group_table;
+  for (uint32_t k = 0; k < filtered.insts.size(); k++) {
+    const auto &entry = filtered.insts[k];
+    for (size_t i = 0; i < entry.stage_count; i++) {
+      uint32_t stage = filtered.stages[entry.stage_begin + i];
+      uint32_t name_id = block.stage_names[stage];
+      uint32_t group = group_table.findOrInsert(name_id, static_cast<uint32_t>(groups.size()));
+      if (group == groups.size()) {
+        groups.emplace_back();
+        groups.back().name_id = name_id;
       }
+      groups[group].stages.emplace_back(block.stage_starts[stage], PipeStage{stage, k});
+    }
+  }
+
+  // 每个分组按 start_time 基数排序并分配 lane；stage 较多时各分组在线程池中并行处理
+  size_t total_stages = filtered.stages.size();
+  if (worker_pool_ && worker_pool_->size() > 1 && groups.size() > 1 &&
+      total_stages >= kParallelPipeStages) {
+    worker_pool_->parallelFor(groups.size(), [&](size_t g) {
+      layoutPipeGroup(groups[g], view_config.lane_policy, block.stage_ends);
+    });
+  } else {
+    for (auto &group : groups) {
+      layoutPipeGroup(group, view_config.lane_policy, block.stage_ends);
     }
+  }
+
+  // track 按 stage name 的字典序输出
+  const StringInterner &names = store.names;
+  std::vector<uint32_t> group_order(groups.size());
+  for (uint32_t g = 0; g < groups.size(); g++) {
+    group_order[g] = g;
+  }
+  std::sort(group_order.begin(), group_order.end(), [&](uint32_t a, uint32_t b) {
+    return names.str(groups[a].name_id) < names.str(groups[b].name_id);
+  });
+
+  int track_rank_id = 0;
+  for (uint32_t g : group_order) {
+    const auto &group = groups[g];
+    const std::string &group_name = names.str(group.name_id);
 
-    int cnt = 0;
-    // 遍历每个track 会按照字典序排列
-    for (auto &track : track_stage_queue_vec) {
+    // 遍历每个 lane，每个 lane 对应一个 track
+    for (uint32_t lane = 0; lane < group.lane_count; lane++) {
       // 如果只有一个 track，不加后缀；否则加 _0, _1 等后缀
       std::string stage_name;
-      if (track_stage_queue_vec.size() == 1) {
-        stage_name = stage_it.first;
+      if (group.lane_count == 1) {
+        stage_name = group_name;
       } else {
-        stage_name = stage_it.first + "_" + std::to_string(cnt++);
+        stage_name = group_name + "_" + std::to_string(lane);
       }
       auto track_name = stage_name;
       auto track_ptr = perfetto_wrapper_.createNamedTrack(
           track_name, stage_name, parent_track, track_rank_id++, false);
 
       // 遍历track中的每个stage
-      while (!track.empty()) {
-        const auto &stage_with_thread = track.front();
-        const auto *stage = stage_with_thread.stage;
-        
+      for (size_t i = group.lane_begin[lane]; i < group.lane_begin[lane + 1]; i++) {
+        const auto &pipe_stage = group.stages[group.lane_stages[i]].second;
+        uint32_t stage = pipe_stage.stage;
+        const auto &entry = filtered.insts[pipe_stage.inst_index];
+        bool first = stage == filtered.stages[entry.stage_begin];
+        bool last = stage == filtered.stages[entry.stage_begin + entry.stage_count - 1];
+
         // 确定 event 名称的优先级：
         // 1. 使用 role 名称（如果存在）
         // 2. 否则使用 show_title（如果非空）
         // 3. 最后使用 stage name
-        std::string event_name;
-        std::string role_name = getRoleName(stage_with_thread.thread_id);
-        if (!role_name.empty()) {
-          event_name = role_name;
-        } else if (!stage->show_title().empty()) {
-          event_name = stage->show_title();
-        } else {
-          event_name = stage->name();
-        }
-        
-        // 使用 instruction 的 global_seq_num 作为 flow_id
-        perfetto_wrapper_.addTraceEvent(
-            event_name, *track_ptr, stage->start_time(), stage->end_time(),
-            (*(stage_with_thread.metadata)), stage->metadata());
-        track.pop();
+        std::string role_name = getRoleName(block.inst_threads[entry.inst]);
+        const std::string &event_name =
+            !role_name.empty() ? role_name : names.str(block.stage_events[stage]);
+
+        addStageEvent(event_name, *track_ptr, store, block, stage, MetadataSpan(),
+                      instMetadataForStage(store, block, entry.inst, first ? 0 : 1,
+                                           view_config.dedup_inst_metadata),
+                      dependencies.stageFlows(pipe_stage.inst_index, first, last), key_filter);
       }
     }
-    track_stage_queue_vec.clear();
+  }
+}
+
+void PerfShower::addStageEvent(const std::string &event_name, perfetto::NamedTrack &track,
+                               const TraceStore &store, const TraceBlock &block, uint32_t stage,
+                               const MetadataSpan &identity, const MetadataSpan &inst_metadata,
+                               const EventFlows &flows, const MetadataKeyFilter *key_filter) {
+  if (flows.empty()) {
+    perfetto_wrapper_.addTraceEvent(event_name, track, block.stage_starts[stage],
+                                    block.stage_ends[stage],
+                                    {identity, inst_metadata, store.stageMetadata(block, stage)},
+                                    key_filter);
+  } else {
+    perfetto_wrapper_.addTraceEventWithFlow(
+        event_name, track, block.stage_starts[stage], block.stage_ends[stage], flows,
+        {identity, inst_metadata, store.stageMetadata(block, stage)}, key_filter);
   }
 }
 
 void PerfShower::processLineMode(
-    const unified_perf_format::BatchInstruction &batch_instruction,
-    perfetto::Track &parent_track) {
+    const TraceStore &store, const TraceBlock &block,
+    const FilteredInstructions &filtered,
+    perfetto::Track &parent_track,
+    const ViewConfig &view_config) {
+  const MetadataKeyFilter *key_filter =
+      view_config.metadata_filter.enabled() ? &view_config.metadata_filter : nullptr;
+  InstDependencyFlows dependencies;
+  if (view_config.dependency_flows) {
+    next_flow_id_ += dependencies.build(block, filtered, next_flow_id_);
+  }
   // Line 模式：按照 instruction 的顺序线性显示
   int track_rank_id = 0;
-  for (const auto &inst : batch_instruction.instructions()) {
-    std::string track_name = "inst_" + std::to_string(inst.thread_id()) + "_" +
-                             std::to_string(inst.global_seq_num());
+  for (size_t k = 0; k < filtered.insts.size(); k++) {
+    const auto &entry = filtered.insts[k];
+    uint32_t inst = entry.inst;
+    std::string track_name = "inst_" + std::to_string(block.inst_threads[inst]) + "_" +
+                             std::to_string(block.inst_seqs[inst]);
     auto track = perfetto_wrapper_.createNamedTrack(
-        track_name, inst.name(), parent_track, track_rank_id++, true);
+        track_name, store.names.str(block.inst_names[inst]), parent_track, track_rank_id++, true);
     
     // 按照 stage 的顺序线性添加
-    for (const auto &stage : inst.stages()) {
+    for (size_t i = 0; i < entry.stage_count; i++) {
+      uint32_t stage = filtered.stages[entry.stage_begin + i];
       // show_title 作为 event 名字，如果为空则使用 name
-      std::string event_name = stage.show_title().empty() ? stage.name() : stage.show_title();
-      perfetto_wrapper_.addTraceEvent(event_name, *track, stage.start_time(),
-                                      stage.end_time(), inst.metadata(),
-                                      stage.metadata());
+      addStageEvent(store.names.str(block.stage_events[stage]), *track, store, block, stage,
+                    MetadataSpan(),
+                    instMetadataForStage(store, block, inst, i, view_config.dedup_inst_metadata),
+                    dependencies.stageFlows(k, i == 0, i + 1 == entry.stage_count), key_filter);
     }
   }
 }
 
+void PerfShower::processLinePackedMode(
+    const TraceStore &store, const TraceBlock &block,
+    const FilteredInstructions &filtered,
+    perfetto::Track &parent_track,
+    const ViewConfig &view_config,
+    InstLanePool &pool) {
+  const MetadataKeyFilter *key_filter =
+      view_config.metadata_filter.enabled() ? &view_config.metadata_filter : nullptr;
+
+  // 指令的生命周期为其（过滤后）stage 的最早开始时间到最晚结束时间
+  std::vector<std::pair<uint64_t, uint32_t>> lifetimes;  // (开始时间, filtered.insts 下标)
+  std::vector<uint64_t> lifetime_end(filtered.insts.size(), 0);
+  lifetimes.reserve(filtered.insts.size());
+  for (uint32_t k = 0; k < filtered.insts.size(); k++) {
+    const auto &entry = filtered.insts[k];
+    if (entry.stage_count == 0) {
+      continue;
+    }
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+    for (size_t i = 0; i < entry.stage_count; i++) {
+      uint32_t stage = filtered.stages[entry.stage_begin + i];
+      start = std::min<uint64_t>(start, block.stage_starts[stage]);
+      end = std::max<uint64_t>(end, block.stage_ends[stage]);
+    }
+    lifetimes.emplace_back(start, k);
+    lifetime_end[k] = end;
+  }
+
+  InstDependencyFlows dependencies;
+  if (view_config.dependency_flows) {
+    next_flow_id_ += dependencies.build(block, filtered, next_flow_id_);
+  }
+
+  // 生命周期互不重叠的指令共用一个 lane，lane 数等于同时在执行的指令数的峰值
+  // 之前数据块创建的 lane 在其最后一条指令结束后可以继续复用
+  std::vector<std::pair<uint64_t, uint32_t>> buffer;
+  radixSortByKey(lifetimes, buffer);
+  std::vector<uint32_t> lane_of;
+  uint32_t lane_count = assignLanes(lifetimes, view_config.lane_policy, view_config.max_lanes,
+                                    pool.lane_end,
+                                    [&](uint32_t k) { return lifetime_end[k]; }, lane_of);
+
+  pool.lane_end.resize(lane_count, 0);
+  for (uint32_t lane = static_cast<uint32_t>(pool.tracks.size()); lane < lane_count; lane++) {
+    std::string track_name = "inst_lane_" + std::to_string(lane);
+    pool.tracks.push_back(perfetto_wrapper_.createNamedTrack(
+        track_name, track_name, parent_track, lane, false));
+  }
+
+  // 指令身份（名称与 "<thread_id>_<global_seq_num>"）作为 metadata 附加到它的每个 stage 上，
+  // 指令自己的 metadata 中已有同名键时以指令的值为准
+  StringInterner identity_strings;
+  const uint32_t identity_keys[] = {identity_strings.intern("inst_name"),
+                                    identity_strings.intern("inst_id")};
+  const uint32_t shadowing_keys[] = {store.strings.find("inst_name"),
+                                     store.strings.find("inst_id")};
+  size_t dropped = 0;
+  for (size_t n = 0; n < lifetimes.size(); n++) {
+    uint32_t lane = lane_of[n];
+    uint32_t k = lifetimes[n].second;
+    const auto &entry = filtered.insts[k];
+    if (lane == kNoLane) {
+      dropped++;
+      continue;
+    }
+    uint32_t inst = entry.inst;
+    MetadataSpan inst_metadata = store.instMetadata(block, inst);
+    const uint32_t identity_values[] = {
+        identity_strings.intern(store.names.str(block.inst_names[inst])),
+        identity_strings.intern(std::to_string(block.inst_threads[inst]) + "_" +
+                                std::to_string(block.inst_seqs[inst]))};
+    // 未被遮盖的身份字段排在前面，带指令 metadata 的 stage 只输出这一段
+    uint32_t keys[2];
+    uint32_t values[2];
+    size_t visible = 0;
+    size_t hidden = 2;
+    for (size_t j = 0; j < 2; j++) {
+      bool shadowed = false;
+      for (size_t m = 0; m < inst_metadata.size; m++) {
+        shadowed = shadowed || inst_metadata.keys[m] == shadowing_keys[j];
+      }
+      size_t slot = shadowed ? --hidden : visible++;
+      keys[slot] = identity_keys[j];
+      values[slot] = identity_values[j];
+    }
+    MetadataSpan identity{&identity_strings, keys, values, 2};
+    MetadataSpan visible_identity{&identity_strings, keys, values, visible};
+
+    pool.lane_end[lane] = std::max(pool.lane_end[lane], lifetime_end[k]);
+    auto &track = *pool.tracks[lane];
+    for (size_t i = 0; i < entry.stage_count; i++) {
+      uint32_t stage = filtered.stages[entry.stage_begin + i];
+      bool with_inst = i == 0 || !view_config.dedup_inst_metadata;
+      addStageEvent(store.names.str(block.stage_events[stage]), track, store, block, stage,
+                    with_inst ? visible_identity : identity,
+                    with_inst ? inst_metadata : MetadataSpan(),
+                    dependencies.stageFlows(k, i == 0, i + 1 == entry.stage_count), key_filter);
+    }
+  }
+  if (dropped > 0) {
+    LOG_WARN("警告：line_packed 模式中 " << dropped << " 条指令超出 max_lanes=" << view_config.max_lanes
+             << " 的上限，未输出");
+  }
+}
+
 void PerfShower::processFuncMode(
-    const unified_perf_format::BatchFunction &batch_function,
+    const TraceStore &store, const TraceBlock &block,
+    const FilteredFunctions &filtered,
     perfetto::Track &parent_track,
-    const std::string &device_name) {
+    const ViewConfig &view_config) {
+  const MetadataKeyFilter *key_filter =
+      view_config.metadata_filter.enabled() ? &view_config.metadata_filter : nullptr;
+  const std::string &device_name = block.device_name;
   // 为每个线程创建一个独立的 track
   // track 名称格式: "device_thread_<device_name>_t<thread_id>"
   std::map<uint32_t, std::shared_ptr<perfetto::NamedTrack>> thread_track_map;
 
-  for (const auto &func : batch_function.functions()) {
-    uint32_t thread_id = func.thread_id();
+  for (uint32_t func : filtered.functions) {
+    uint32_t thread_id = block.func_threads[func];
     
     // 检查是否已经为该线程创建了 track
     if (thread_track_map.find(thread_id) == thread_track_map.end()) {
@@ -302,25 +761,29 @@ void PerfShower::processFuncMode(
     
     auto thread_track = thread_track_map.at(thread_id);
     
-    // 使用新的 Function 格式：直接使用 start_timestamp 和 end_timestamp
-    // 每个 Function 代表一个时间范围，直接添加为 trace event
+    // 每个 Function 代表一个时间范围 [start_timestamp, end_timestamp]，直接添加为 trace event
     perfetto_wrapper_.addTraceEvent(
-        func.name(), *thread_track,
-        func.start_timestamp(), func.end_timestamp(),
-        func.metadata(), MetadataMap());
+        store.names.str(block.func_names[func]), *thread_track,
+        block.func_starts[func], block.func_ends[func],
+        {store.funcMetadata(block, func)}, key_filter);
   }
 }
 
 void PerfShower::processCntMode(
-    const unified_perf_format::BatchCounter &batch_counter,
+    const TraceStore &store, const TraceBlock &block,
+    const FilteredCounters &filtered,
     perfetto::Track &parent_track) {
-  for (const auto &cnt : batch_counter.counters()) {
+  for (const auto &entry : filtered.counters) {
     auto track = perfetto_wrapper_.createCounterTrack(
-        "counter_" + cnt.name(), cnt.unit(), parent_track);
+        "counter_" + store.names.str(block.cnt_names[entry.cnt]),
+        store.names.str(block.cnt_units[entry.cnt]), parent_track);
 
-    for (const auto &value : cnt.values()) {
-      perfetto_wrapper_.addCounterEvent(*track, value.timestamp(),
-                                        value.value());
+    for (size_t i = 0; i < entry.range_count; i++) {
+      const auto &range = filtered.ranges[entry.range_begin + i];
+      for (uint32_t sample = range.begin; sample < range.end; sample++) {
+        perfetto_wrapper_.addCounterEvent(*track, block.sample_times[sample],
+                                          block.sample_values[sample]);
+      }
     }
   }
 }
@@ -330,7 +793,7 @@ JsonConfig PerfShower::parseShowJson(const std::string &json_path) {
   
   std::ifstream file(json_path);
   if (!file.is_open()) {
-    std::cerr << "错误：无法打开 JSON 文件 " << json_path << std::endl;
+    LOG_ERROR("错误：无法打开 JSON 文件 " << json_path);
     return config;
   }
 
@@ -338,7 +801,7 @@ JsonConfig PerfShower::parseShowJson(const std::string &json_path) {
   try {
     file >> j;
   } catch (const json::parse_error &e) {
-    std::cerr << "错误：JSON 解析失败: " << e.what() << std::endl;
+    LOG_ERROR("错误：JSON 解析失败: " << e.what());
     return config;
   }
 
@@ -349,21 +812,38 @@ JsonConfig PerfShower::parseShowJson(const std::string &json_path) {
         config.filelist.push_back(file_path.get<std::string>());
       }
     }
-    std::cout << "从 JSON 配置中读取到 " << config.filelist.size() << " 个输入文件" << std::endl;
+    LOG_INFO("从 JSON 配置中读取到 " << config.filelist.size() << " 个输入文件");
   }
 
   // 解析 output 字段（如果存在）
   if (j.contains("output") && j["output"].is_string()) {
     config.output = j["output"].get<std::string>();
-    std::cout << "从 JSON 配置中读取到输出文件路径: " << config.output << std::endl;
+    LOG_INFO("从 JSON 配置中读取到输出文件路径: " << config.output);
+  }
+
+  // 解析 fused_views 字段（如果存在）
+  if (j.contains("fused_views") && j["fused_views"].is_boolean()) {
+    config.fused_views = j["fused_views"].get<bool>();
+  }
+
+  // 解析 jobs 字段（如果存在）
+  if (j.contains("jobs") && j["jobs"].is_number_integer()) {
+    config.jobs = j["jobs"].get<int>();
+    LOG_INFO("从 JSON 配置中读取到并行线程数: " << config.jobs);
+  }
+
+  // 解析 backend 字段（如果存在）
+  if (j.contains("backend") && j["backend"].is_string()) {
+    config.backend = j["backend"].get<std::string>();
   }
 
   // 解析视图配置
   for (auto it = j.begin(); it != j.end(); ++it) {
     const std::string &view_name = it.key();
-    // 跳过 "filelist"、"output"、"kernel" 和 "role" 字段，它们不是视图配置
+    // 跳过 "filelist"、"output"、"kernel"、"role"、"jobs"、"fused_views" 和 "backend" 字段，它们不是视图配置
     if (view_name == "filelist" || view_name == "output" || 
-        view_name == "kernel" || view_name == "role") {
+        view_name == "kernel" || view_name == "role" || view_name == "jobs" ||
+        view_name == "fused_views" || view_name == "backend") {
       continue;
     }
     
@@ -398,379 +878,616 @@ JsonConfig PerfShower::parseShowJson(const std::string &json_path) {
     parseFilterArray("device_filter", view_config.device_filter);
     parseFilterArray("thread_filter", view_config.thread_filter);
 
+    // 时间线规则只在这里解析一次，编译为有序且合并后的区间集合
+    std::vector<std::string> timeline_rules;
+    for (const auto &rule : view_config.timeline_filter) {
+      timeline_rules.push_back(rule.value);
+    }
+    view_config.timeline.compile(timeline_rules);
+
+    // 名称类过滤器编译为多模式匹配器，一次扫描即可匹配所有规则
+    auto compileMatcher = [](const std::vector<FilterRule> &filters, SubstringMatcher &matcher) {
+      std::vector<std::string> patterns;
+      for (const auto &rule : filters) {
+        patterns.push_back(rule.value);
+      }
+      matcher.compile(patterns);
+    };
+    compileMatcher(view_config.event_filter, view_config.event_matcher);
+    compileMatcher(view_config.track_filter, view_config.track_matcher);
+    compileMatcher(view_config.device_filter, view_config.device_matcher);
+
+    // where 表达式只编译一次；表达式有误时跳过该视图，避免输出未按预期过滤的数据
+    if (view_obj.contains("where") && view_obj["where"].is_string()) {
+      std::string where_text = view_obj["where"].get<std::string>();
+      std::string error;
+      if (!view_config.where.compile(where_text, error)) {
+        LOG_ERROR("错误：视图 " << view_name << " 的 where 表达式无效: " << error
+                  << "，跳过该视图");
+        continue;
+      }
+      LOG_INFO("视图 " << view_name << " 的 where 表达式编译为: "
+               << view_config.where.describe());
+    }
+
+    if (view_obj.contains("dedup_inst_metadata") && view_obj["dedup_inst_metadata"].is_boolean()) {
+      view_config.dedup_inst_metadata = view_obj["dedup_inst_metadata"].get<bool>();
+    }
+
+    if (view_obj.contains("dependency_flows") && view_obj["dependency_flows"].is_boolean()) {
+      view_config.dependency_flows = view_obj["dependency_flows"].get<bool>();
+    }
+
+    if (view_obj.contains("max_lanes") && view_obj["max_lanes"].is_number_unsigned()) {
+      view_config.max_lanes = view_obj["max_lanes"].get<uint32_t>();
+    }
+
+    if (view_obj.contains("lane_policy") && view_obj["lane_policy"].is_string()) {
+      std::string policy = view_obj["lane_policy"].get<std::string>();
+      if (policy == "small_first" || policy == "SMALL_FIRST") {
+        view_config.lane_policy = LanePolicy::kSmallFirst;
+      } else if (policy == "last_step_first" || policy == "LAST_STEP_FIRST") {
+        view_config.lane_policy = LanePolicy::kLastStepFirst;
+      } else {
+        LOG_WARN("警告：视图 " << view_name << " 的 lane_policy \"" << policy
+                 << "\" 无效，使用 small_first");
+      }
+    }
+
+    // metadata 键列表解析一次为驻留键集合，输出时不需要的键在驻留和序列化之前跳过
+    auto parseStringArray = [&view_obj](const std::string &key, std::vector<std::string> &values) {
+      if (view_obj.contains(key) && view_obj[key].is_array()) {
+        for (const auto &value : view_obj[key]) {
+          if (value.is_string()) {
+            values.push_back(value.get<std::string>());
+          }
+        }
+      }
+    };
+    parseStringArray("metadata_keys", view_config.metadata_keys);
+    parseStringArray("drop_metadata_keys", view_config.drop_metadata_keys);
+    view_config.metadata_filter.compile(view_config.metadata_keys, view_config.drop_metadata_keys);
+
     config.views[view_name] = view_config;
   }
 
   // 解析 kernel 字段
   if (j.contains("kernel") && j["kernel"].is_string()) {
     config.kernel = j["kernel"].get<std::string>();
-    std::cout << "从 JSON 配置中读取到 kernel 名称: " << config.kernel << std::endl;
+    LOG_INFO("从 JSON 配置中读取到 kernel 名称: " << config.kernel);
   }
 
   // 解析 role 字段
   if (j.contains("role") && j["role"].is_string()) {
     config.role_path = j["role"].get<std::string>();
-    std::cout << "从 JSON 配置中读取到 role 路径: " << config.role_path << std::endl;
+    LOG_INFO("从 JSON 配置中读取到 role 路径: " << config.role_path);
   }
 
   return config;
 }
 
-bool PerfShower::passTimelineFilter(const std::vector<FilterRule> &filters, 
+bool PerfShower::passTimelineFilter(const TimelineFilter &filter, 
                                     uint64_t start_time, uint64_t end_time) {
-  // 如果过滤器为空（JSON 中未指定），则通过所有数据
-  if (filters.empty()) return true;
-  
-  for (const auto &rule : filters) {
-    // 解析时间范围，格式: "start-end" 或单个时间戳
-    std::string value = rule.value;
-    size_t dash_pos = value.find('-');
-    if (dash_pos != std::string::npos) {
-      uint64_t filter_start = std::stoull(value.substr(0, dash_pos));
-      uint64_t filter_end = std::stoull(value.substr(dash_pos + 1));
-      // 检查时间范围是否有重叠：只要 stage 的时间范围与 filter 的时间范围有任何重叠，
-      // 就返回 true（整个 stage 都会被绘制，而不仅仅是重叠的部分）
-      // 重叠条件：stage.start <= filter.end && stage.end >= filter.start
-      if (start_time <= filter_end && end_time >= filter_start) {
-        return true;
-      }
-    } else {
-      // 单个时间戳，检查该时间戳是否在 stage 的时间范围内
-      uint64_t timestamp = std::stoull(value);
-      if (timestamp >= start_time && timestamp <= end_time) {
-        return true;
-      }
-    }
-  }
-  return false;
+  // 如果过滤器为空（JSON 中未指定），则通过所有数据；
+  // 否则只要时间范围与任一过滤区间有重叠就通过（整个 stage 都会被绘制，而不仅仅是重叠的部分）
+  return filter.pass(start_time, end_time);
 }
 
-bool PerfShower::passEventFilter(const std::vector<FilterRule> &filters, 
-                                 const std::string &event_name) {
-  // 如果过滤器为空（JSON 中未指定），则通过所有数据
-  if (filters.empty()) return true;
-  
-  for (const auto &rule : filters) {
-    if (event_name.find(rule.value) != std::string::npos) {
-      return true;
-    }
-  }
-  return false;
+bool PerfShower::passEventFilter(const NameBitset &bits, uint32_t event_name_id) {
+  // 每个不同名称的匹配结果已预先计算（过滤器为空时所有名称都通过）
+  return bits.test(event_name_id);
 }
 
-bool PerfShower::passTrackFilter(const std::vector<FilterRule> &filters, 
-                                 const std::string &track_name) {
-  // 如果过滤器为空（JSON 中未指定），则通过所有数据
-  if (filters.empty()) return true;
-  
-  for (const auto &rule : filters) {
-    if (track_name.find(rule.value) != std::string::npos) {
-      return true;
-    }
-  }
-  return false;
+bool PerfShower::passTrackFilter(const NameBitset &bits, uint32_t track_name_id) {
+  // 每个不同名称的匹配结果已预先计算（过滤器为空时所有名称都通过）
+  return bits.test(track_name_id);
 }
 
-bool PerfShower::passDeviceFilter(const std::vector<FilterRule> &filters, 
+bool PerfShower::passDeviceFilter(const SubstringMatcher &matcher, 
                                   const std::string &device_name) {
-  // 如果过滤器为空（JSON 中未指定），则通过所有数据
-  if (filters.empty()) return true;
-  
-  for (const auto &rule : filters) {
-    if (device_name.find(rule.value) != std::string::npos) {
-      return true;
+  // 如果过滤器为空（JSON 中未指定），则通过所有数据；
+  // 否则名称包含任一规则子串即通过
+  return matcher.matches(device_name);
+}
+
+bool PerfShower::passThreadFilter(const ThreadFilter &filter, uint32_t thread_id) {
+  // 如果过滤器为空（JSON 中未指定），则通过所有数据；否则只需一次位测试
+  return filter.pass(thread_id);
+}
+
+size_t PerfShower::readPerfDataFromFile(const std::string &bin_file_path, TraceStore &store) {
+  size_t block_count = 0;
+  size_t invalid_count = 0;
+  // 格式非法的数据块无法还原，跳过它并继续读取后续数据块
+  auto add_block = [&](const UnifiedPerfData &perf_data,
+                       const google::protobuf::RepeatedPtrField<std::string> *shared_table) {
+    if (store.add(perf_data, shared_table)) {
+      block_count++;
+    } else {
+      LOG_ERROR("错误：文件 " << bin_file_path << " 的第 " << block_count + invalid_count + 1
+                << " 个数据块格式非法（字符串 ID 不存在、metadata_ids 不成对"
+                << "或打包采样点个数不一致），已跳过");
+      invalid_count++;
     }
+  };
+
+  // 优先使用内存映射，直接在映射区域上解析，省去 ifstream 的缓冲拷贝；
+  // 管道等无法映射的输入回退到基于文件描述符的流式读取
+  MappedFile mapped_file;
+  bool is_mapped = mapped_file.open(bin_file_path);
+  std::unique_ptr<PerfDataStreamReader> stream_reader;
+  if (is_mapped) {
+    stream_reader = std::make_unique<PerfDataStreamReader>(mapped_file.data(),
+                                                           mapped_file.size());
+  } else {
+    stream_reader = std::make_unique<PerfDataStreamReader>(bin_file_path);
   }
-  return false;
-}
 
-bool PerfShower::passThreadFilter(const std::vector<FilterRule> &filters, 
-                                  uint32_t thread_id) {
-  // 如果过滤器为空（JSON 中未指定），则通过所有数据
-  if (filters.empty()) return true;
-  
-  for (const auto &rule : filters) {
-    uint32_t filter_thread = std::stoul(rule.value);
-    if (thread_id == filter_thread) {
-      return true;
+  // 优先尝试分块流式格式：每次只在 arena 上解析一个 chunk，转换为列式存储后整体释放 arena，
+  // 相邻 chunk 的数据类型通常不同，复用同一个堆上的消息反而要逐个析构再重新分配子消息
+  if (stream_reader->open()) {
+    google::protobuf::Arena arena;
+    while (true) {
+      auto *perf_data = google::protobuf::Arena::CreateMessage<UnifiedPerfData>(&arena);
+      if (!stream_reader->next(perf_data)) {
+        break;
+      }
+      add_block(*perf_data, nullptr);
+      arena.Reset();
+      // 已解析的 chunk 不会再被访问，及时归还映射页，峰值内存接近列式数据的大小
+      mapped_file.releaseUpTo(stream_reader->consumedBytes());
     }
+    if (stream_reader->hasError()) {
+      LOG_WARN("警告：文件 " << bin_file_path << " 读取中断，保留已读取的 "
+               << block_count << " 个数据块");
+    }
+    LOG_INFO("使用分块流式格式读取，共 " << block_count << " 个数据块"
+             << (is_mapped ? "（mmap）" : ""));
+    return block_count;
+  }
+  if (stream_reader->hasError()) {
+    return block_count;
   }
-  return false;
-}
 
-std::vector<UnifiedPerfData> PerfShower::readPerfDataFromFile(const std::string &bin_file_path) {
-  std::vector<UnifiedPerfData> perf_data_list;
-  
-  std::ifstream file_stream(bin_file_path, std::ios::in | std::ios::binary);
-  if (!file_stream.is_open()) {
-    std::cerr << "错误：无法打开文件 " << bin_file_path << std::endl;
-    return perf_data_list;
+  // 旧格式是整个文件一个消息，根据数据源选择解析方式
+  std::ifstream file_stream;
+  std::function<bool(google::protobuf::Message &)> parse_whole_file;
+  if (is_mapped) {
+    if (mapped_file.size() > static_cast<size_t>(INT_MAX)) {
+      LOG_ERROR("错误：文件 " << bin_file_path << " 超过 2GB，"
+                << "容器消息格式无法解析，请改用分块流式格式");
+      return block_count;
+    }
+    parse_whole_file = [&mapped_file](google::protobuf::Message &msg) {
+      return msg.ParseFromArray(mapped_file.data(),
+                                static_cast<int>(mapped_file.size()));
+    };
+  } else {
+    file_stream.open(bin_file_path, std::ios::in | std::ios::binary);
+    if (!file_stream.is_open()) {
+      LOG_ERROR("错误：无法打开文件 " << bin_file_path);
+      return block_count;
+    }
+    parse_whole_file = [&file_stream](google::protobuf::Message &msg) {
+      file_stream.clear();
+      file_stream.seekg(0, std::ios::beg);
+      return msg.ParseFromIstream(&file_stream);
+    };
   }
 
-  // 先尝试读取容器消息格式（推荐方式）
-  unified_perf_format::UnifiedPerfDataContainer container;
-  if (container.ParseFromIstream(&file_stream)) {
-    // 成功读取容器消息，提取所有数据
-    for (int i = 0; i < container.data_list_size(); i++) {
-      perf_data_list.push_back(container.data_list(i));
+  // 整个文件的消息分配在临时 arena 上，转换完成后随 arena 一起整块释放
+  google::protobuf::ArenaOptions arena_options;
+  arena_options.start_block_size = 64 << 10;
+  arena_options.max_block_size = 16 << 20;
+  google::protobuf::Arena arena(arena_options);
+
+  // 再尝试读取容器消息格式
+  auto *container =
+      google::protobuf::Arena::CreateMessage<unified_perf_format::UnifiedPerfDataContainer>(&arena);
+  // 单个 UnifiedPerfData 的字段在容器看来都是未知字段，也能"解析成功"，
+  // 因此没有任何数据块时继续尝试单个消息格式
+  if (parse_whole_file(*container) && container->data_list_size() > 0) {
+    for (const auto &perf_data : container->data_list()) {
+      add_block(perf_data, &container->string_table());
     }
-    std::cout << "使用容器消息格式读取，共 " << perf_data_list.size() << " 个数据块" << std::endl;
-    return perf_data_list;
+    LOG_INFO("使用容器消息格式读取，共 " << block_count << " 个数据块");
+    return block_count;
   }
   
   // 如果容器消息格式失败，尝试单个 UnifiedPerfData 格式（向后兼容）
-  file_stream.clear();
-  file_stream.seekg(0, std::ios::beg);
-  UnifiedPerfData perf_data;
-  if (perf_data.ParseFromIstream(&file_stream)) {
-    perf_data_list.push_back(perf_data);
-    std::cout << "使用单个消息格式读取" << std::endl;
-    return perf_data_list;
+  auto *perf_data = google::protobuf::Arena::CreateMessage<UnifiedPerfData>(&arena);
+  if (parse_whole_file(*perf_data)) {
+    add_block(*perf_data, nullptr);
+    LOG_INFO("使用单个消息格式读取");
+    return block_count;
   }
   
-  std::cerr << "错误：无法解析文件 " << bin_file_path 
-            << "（既不是容器消息格式，也不是单个消息格式）" << std::endl;
-  return perf_data_list;
+  LOG_ERROR("错误：无法解析文件 " << bin_file_path 
+            << "（既不是容器消息格式，也不是单个消息格式）");
+  return block_count;
 }
 
-std::vector<UnifiedPerfData> PerfShower::readPerfDataFromFiles(const std::vector<std::string> &bin_file_paths) {
-  std::vector<UnifiedPerfData> merged_perf_data_list;
-  
-  for (const auto &bin_file_path : bin_file_paths) {
-    std::cout << "读取性能数据文件: " << bin_file_path << std::endl;
-    auto perf_data_list = readPerfDataFromFile(bin_file_path);
-    if (!perf_data_list.empty()) {
-      // 将读取到的数据合并到总列表中
-      merged_perf_data_list.insert(merged_perf_data_list.end(), 
-                                    perf_data_list.begin(), 
-                                    perf_data_list.end());
-      std::cout << "成功从文件 " << bin_file_path << " 读取 " 
-                << perf_data_list.size() << " 个数据块" << std::endl;
+TraceStore PerfShower::readPerfDataFromFiles(const std::vector<std::string> &bin_file_paths,
+                                             int jobs) {
+  TraceStore store;
+
+  // 每个文件先转换到自己的局部 store（局部驻留表），合并时按文件列表顺序进行并映射为全局 ID，
+  // 保证结果确定
+  std::vector<TraceStore> per_file_stores(bin_file_paths.size());
+  ThreadPool pool(ThreadPool::resolveJobs(jobs, bin_file_paths.size()));
+  LOG_INFO("使用 " << pool.size() << " 个线程读取 " << bin_file_paths.size()
+           << " 个性能数据文件");
+  pool.parallelFor(bin_file_paths.size(), [&](size_t i) {
+    readPerfDataFromFile(bin_file_paths[i], per_file_stores[i]);
+  });
+
+  for (size_t i = 0; i < bin_file_paths.size(); i++) {
+    size_t block_count = per_file_stores[i].blocks.size();
+    if (block_count > 0) {
+      store.append(std::move(per_file_stores[i]));
+      LOG_INFO("成功从文件 " << bin_file_paths[i] << " 读取 " << block_count << " 个数据块");
     } else {
-      std::cerr << "警告：文件 " << bin_file_path << " 未读取到任何数据" << std::endl;
+      LOG_WARN("警告：文件 " << bin_file_paths[i] << " 未读取到任何数据");
     }
+    per_file_stores[i] = TraceStore();
   }
   
-  std::cout << "总共读取 " << merged_perf_data_list.size() << " 个数据块" << std::endl;
-  return merged_perf_data_list;
+  LOG_INFO("总共读取 " << store.blocks.size() << " 个数据块，列式存储约 "
+           << store.memoryBytes() << " 字节，不同名称 " << store.names.size()
+           << " 个，不同 metadata 字符串 " << store.strings.size() << " 个");
+  return store;
 }
 
-void PerfShower::processDataWithView(const ViewConfig &view_config, 
-                                     const std::vector<UnifiedPerfData> &perf_data_list,
-                                     perfetto::Track &view_track) {
-  // 注意：此方法不会修改 perf_data_list 中的原始数据
-  // 所有过滤操作都在新创建的对象上进行（filtered_batch, filtered_inst 等）
-  // 使用 CopyFrom() 复制数据，确保原始数据保持不变
-  
-  std::cout << "processDataWithView: 处理 " << perf_data_list.size() << " 个数据块，模式: " << view_config.mode << std::endl;
-  
-  // 缓存已创建的 device track，避免重复创建
-  std::map<std::string, std::shared_ptr<perfetto::NamedTrack>> device_track_map;
-  
-  // 处理每个消息
-  for (const auto &perf_data : perf_data_list) {
-    std::cout << "  处理数据块: device_name=" << perf_data.device_name() 
-              << ", data_type=" << perf_data.data_type() 
-              << ", has_instructions=" << perf_data.has_instructions()
-              << ", has_functions=" << perf_data.has_functions()
-              << ", has_counters=" << perf_data.has_counters() << std::endl;
-    
-    // 检查设备过滤器
-    if (!passDeviceFilter(view_config.device_filter, perf_data.device_name())) {
-      std::cout << "    设备过滤器未通过，跳过" << std::endl;
-      continue;
+void PerfShower::filterInstruction(const ViewConfig &view_config,
+                                   const NameFilterBits &name_bits,
+                                   const TraceStore &store,
+                                   const TraceBlock &block,
+                                   uint32_t inst,
+                                   FilteredInstructions &filtered,
+                                   bool check_timeline) {
+  // 应用所有可用的过滤器
+  if (!passThreadFilter(view_config.thread, block.inst_threads[inst])) {
+    return;
+  }
+  // line 模式中 track 对应 instruction，track_filter 过滤 instruction 的 name
+  bool is_pipe = view_config.mode == "pipe";
+  if (!is_pipe && !passTrackFilter(name_bits.track, block.inst_names[inst])) {
+    return;
+  }
+
+  // where 表达式：不涉及 stage 字段时每条指令只求值一次，否则在下面逐 stage 求值
+  const FilterExpr &where = view_config.where;
+  bool where_per_stage = where.enabled() && where.usesStage();
+  FilterRecord record;
+  if (where.enabled()) {
+    record.store = &store;
+    record.block = &block;
+    record.inst = inst;
+    if (!where_per_stage && !where.eval(record)) {
+      return;
     }
+  }
 
-    // 检查是否已经为该设备创建了 track，如果没有则创建
-    std::shared_ptr<perfetto::NamedTrack> device_track;
-    const std::string &device_name = perf_data.device_name();
-    auto it = device_track_map.find(device_name);
-    if (it != device_track_map.end()) {
-      // 复用已创建的 track
-      device_track = it->second;
-      std::cout << "    复用已存在的 device track: " << device_name << std::endl;
-    } else {
-      // 创建新的 device track
-      device_track = perfetto_wrapper_.createNamedTrack(
-          "device_" + device_name, "Device: " + device_name, 
-          view_track, 0, false);
-      device_track_map[device_name] = device_track;
-      std::cout << "    创建新的 device track: " << device_name << std::endl;
-    }
-
-  // 根据 mode 处理数据
-  if (view_config.mode == "pipe" && perf_data.has_instructions()) {
-    // 应用过滤器处理 instructions
-    auto &batch_instruction = perf_data.instructions();
-    std::cout << "    处理 pipe 模式，共有 " << batch_instruction.instructions_size() << " 个指令" << std::endl;
-    unified_perf_format::BatchInstruction filtered_batch;
-    
-    for (const auto &inst : batch_instruction.instructions()) {
-      // 应用所有可用的过滤器
-      if (!passThreadFilter(view_config.thread_filter, inst.thread_id())) {
-        continue;
-      }
+  size_t stage_begin = filtered.stages.size();
+  for (uint32_t s = block.inst_stage_begin[inst]; s < block.inst_stage_begin[inst + 1]; s++) {
+    // track_filter 过滤 stage 的 name（pipe mode 中 track 是按 stage name 分组的）
+    if (is_pipe && !passTrackFilter(name_bits.track, block.stage_names[s])) {
+      continue;
+    }
 
-      bool has_valid_stage = false;
-      unified_perf_format::Instruction filtered_inst;
-      filtered_inst.CopyFrom(inst);
-      filtered_inst.clear_stages();
-      
-      for (const auto &stage : inst.stages()) {
-        // track_filter 过滤 stage 的 name（pipe mode 中 track 是按 stage name 分组的）
-        if (!passTrackFilter(view_config.track_filter, stage.name())) {
+    // show_title 作为 event 名字，如果为空则使用 name（读取时已经按此规则选好）
+    if ((!check_timeline ||
+         passTimelineFilter(view_config.timeline, block.stage_starts[s], block.stage_ends[s])) &&
+        passEventFilter(name_bits.event, block.stage_events[s])) {
+      if (where_per_stage) {
+        record.stage = s;
+        if (!where.eval(record)) {
           continue;
         }
-        
-        // show_title 作为 event 名字，如果为空则使用 name
-        std::string event_name = stage.show_title().empty() ? stage.name() : stage.show_title();
-        if (passTimelineFilter(view_config.timeline_filter, 
-                               stage.start_time(), stage.end_time()) &&
-            passEventFilter(view_config.event_filter, event_name)) {
-          auto *new_stage = filtered_inst.add_stages();
-          new_stage->CopyFrom(stage);
-          has_valid_stage = true;
-        }
       }
-      
-      if (has_valid_stage) {
-        auto *new_inst = filtered_batch.add_instructions();
-        new_inst->CopyFrom(filtered_inst);
+      filtered.stages.push_back(s);
+    }
+  }
+
+  size_t stage_count = filtered.stages.size() - stage_begin;
+  if (stage_count > 0) {
+    filtered.insts.push_back({inst, stage_begin, stage_count});
+  }
+}
+
+void PerfShower::filterFunction(const ViewConfig &view_config,
+                                const NameFilterBits &name_bits,
+                                const TraceStore &store,
+                                const TraceBlock &block,
+                                uint32_t func,
+                                FilteredFunctions &filtered,
+                                bool check_timeline) {
+  // 应用所有可用的过滤器
+  if (!passThreadFilter(view_config.thread, block.func_threads[func])) {
+    return;
+  }
+  uint32_t func_name_id = block.func_names[func];
+  if (!passTrackFilter(name_bits.track, func_name_id)) {
+    return;
+  }
+
+  if ((!check_timeline ||
+       passTimelineFilter(view_config.timeline, block.func_starts[func], block.func_ends[func])) &&
+      passEventFilter(name_bits.event, func_name_id)) {
+    if (view_config.where.enabled()) {
+      FilterRecord record;
+      record.store = &store;
+      record.block = &block;
+      record.func = func;
+      if (!view_config.where.eval(record)) {
+        return;
       }
     }
-    
-    std::cout << "    过滤后剩余 " << filtered_batch.instructions_size() << " 个有效指令" << std::endl;
-    if (filtered_batch.instructions_size() > 0) {
-      processPipMode(filtered_batch, *device_track);
-      std::cout << "    已调用 processPipMode" << std::endl;
-    } else {
-      std::cout << "    警告：没有有效指令，跳过 processPipMode" << std::endl;
+    filtered.functions.push_back(func);
+  }
+}
+
+void PerfShower::filterCounter(const ViewConfig &view_config,
+                               const NameFilterBits &name_bits,
+                               const TraceStore &store,
+                               const TraceBlock &block,
+                               uint32_t cnt,
+                               FilteredCounters &filtered,
+                               bool check_timeline) {
+  // 应用所有可用的过滤器
+  uint32_t cnt_name_id = block.cnt_names[cnt];
+  if (!passTrackFilter(name_bits.track, cnt_name_id)) {
+    return;
+  }
+  if (!passEventFilter(name_bits.event, cnt_name_id)) {
+    return;
+  }
+  if (view_config.where.enabled()) {
+    FilterRecord record;
+    record.store = &store;
+    record.block = &block;
+    record.cnt = cnt;
+    if (!view_config.where.eval(record)) {
+      return;
     }
-    
-  } else if (view_config.mode == "line" && perf_data.has_instructions()) {
-    std::cout << "    处理 line 模式，共有 " << perf_data.instructions().instructions_size() << " 个指令" << std::endl;
-    auto &batch_instruction = perf_data.instructions();
-    unified_perf_format::BatchInstruction filtered_batch;
-    
-    for (const auto &inst : batch_instruction.instructions()) {
-      // 应用所有可用的过滤器
-      if (!passThreadFilter(view_config.thread_filter, inst.thread_id())) {
-        continue;
-      }
-      if (!passTrackFilter(view_config.track_filter, inst.name())) {
-        continue;
-      }
-      
-      bool has_valid_stage = false;
-      unified_perf_format::Instruction filtered_inst;
-      filtered_inst.CopyFrom(inst);
-      filtered_inst.clear_stages();
-      
-      for (const auto &stage : inst.stages()) {
-        // show_title 作为 event 名字，如果为空则使用 name
-        std::string event_name = stage.show_title().empty() ? stage.name() : stage.show_title();
-        if (passTimelineFilter(view_config.timeline_filter, 
-                               stage.start_time(), stage.end_time()) &&
-            passEventFilter(view_config.event_filter, event_name)) {
-          auto *new_stage = filtered_inst.add_stages();
-          new_stage->CopyFrom(stage);
-          has_valid_stage = true;
+  }
+
+  size_t range_begin = filtered.ranges.size();
+  uint32_t sample_begin = block.cnt_sample_begin[cnt];
+  uint32_t sample_end = block.cnt_sample_begin[cnt + 1];
+  if (!check_timeline) {
+    if (sample_begin < sample_end) {
+      filtered.ranges.push_back({sample_begin, sample_end});
+    }
+  } else {
+    // 连续通过的采样点合并为一个区间
+    uint32_t run_begin = sample_begin;
+    for (uint32_t sample = sample_begin; sample < sample_end; sample++) {
+      uint64_t timestamp = block.sample_times[sample];
+      if (!passTimelineFilter(view_config.timeline, timestamp, timestamp)) {
+        if (run_begin < sample) {
+          filtered.ranges.push_back({run_begin, sample});
         }
-      }
-      
-      if (has_valid_stage) {
-        auto *new_inst = filtered_batch.add_instructions();
-        new_inst->CopyFrom(filtered_inst);
+        run_begin = sample + 1;
       }
     }
-    
-    if (filtered_batch.instructions_size() > 0) {
-      processLineMode(filtered_batch, *device_track);
+    if (run_begin < sample_end) {
+      filtered.ranges.push_back({run_begin, sample_end});
     }
-    
-  } else if (view_config.mode == "func" && perf_data.has_functions()) {
-    std::cout << "    处理 func 模式，共有 " << perf_data.functions().functions_size() << " 个函数" << std::endl;
-    auto &batch_function = perf_data.functions();
-    unified_perf_format::BatchFunction filtered_batch;
-    
-    for (const auto &func : batch_function.functions()) {
-      // 应用所有可用的过滤器
-      if (!passThreadFilter(view_config.thread_filter, func.thread_id())) {
+  }
+
+  size_t range_count = filtered.ranges.size() - range_begin;
+  if (range_count > 0) {
+    filtered.counters.push_back({cnt, range_begin, range_count});
+  }
+}
+
+void PerfShower::processDataWithView(const ViewConfig &view_config, 
+                                     const TraceStore &store,
+                                     perfetto::Track &view_track) {
+  processDataWithViews({&view_config}, store, {&view_track});
+}
+
+void PerfShower::processDataWithViews(const std::vector<const ViewConfig *> &view_configs,
+                                      const TraceStore &store,
+                                      const std::vector<perfetto::Track *> &view_tracks) {
+  // 注意：此方法不会修改 store 中的数据
+  // 过滤结果只记录指令 / stage / 函数 / 采样点在数据块中的下标，不拷贝任何数据，
+  // 额外视图的开销只有过滤条件的判断
+
+  // 每个视图在一次遍历中的运行状态
+  struct ViewState {
+    const ViewConfig *config;
+    perfetto::Track *view_track;
+    // 缓存已创建的 device track，避免重复创建
+    std::map<std::string, std::shared_ptr<perfetto::NamedTrack>> device_track_map;
+    std::shared_ptr<perfetto::NamedTrack> device_track;  // 当前数据块对应的 device track
+    std::map<std::string, InstLanePool> lane_pools;       // line_packed 模式每个 device 的 lane 池
+    // 过滤结果在数据块之间复用，避免反复分配
+    FilteredInstructions filtered_insts;
+    FilteredFunctions filtered_funcs;
+    FilteredCounters filtered_cnts;
+    NameFilterBits name_bits;  // 按名称 ID 预先计算的 event/track 过滤结果
+    bool check_timeline;  // 当前数据块是否需要逐条检查时间线过滤器
+    // 汇总统计：遍历结束后每个视图输出一行，代替逐数据块的日志
+    size_t blocks_processed = 0;
+    size_t blocks_device_skipped = 0;
+    size_t blocks_mode_mismatched = 0;
+    size_t blocks_timeline_skipped = 0;
+    size_t records_emitted = 0;  // 通过过滤的指令 / 函数 / 计数器
+    size_t events_emitted = 0;   // 通过过滤的 stage / 函数 / 采样点
+  };
+
+  std::vector<ViewState> view_states(view_configs.size());
+  for (size_t v = 0; v < view_configs.size(); v++) {
+    view_states[v].config = view_configs[v];
+    view_states[v].view_track = view_tracks[v];
+    view_states[v].name_bits.event.build(view_configs[v]->event_matcher, store.names);
+    view_states[v].name_bits.track.build(view_configs[v]->track_matcher, store.names);
+    LOG_DEBUG("processDataWithView: 处理 " << store.blocks.size() << " 个数据块，模式: "
+              << view_configs[v]->mode);
+  }
+
+  // 当前数据块中需要处理的视图
+  std::vector<ViewState *> active_views;
+  
+  // 处理每个数据块
+  for (const auto &block : store.blocks) {
+    const TimeSpan &block_span = block.span;
+    const std::string &device_name = block.device_name;
+    bool has_instructions = block.kind == TraceBlock::Kind::kInstructions;
+    bool has_functions = block.kind == TraceBlock::Kind::kFunctions;
+    bool has_counters = block.kind == TraceBlock::Kind::kCounters;
+    LOG_DEBUG("  处理数据块: device_name=" << device_name 
+              << ", has_instructions=" << has_instructions
+              << ", has_functions=" << has_functions
+              << ", has_counters=" << has_counters);
+
+    active_views.clear();
+    for (auto &view_state : view_states) {
+      const ViewConfig &view_config = *view_state.config;
+
+      // 检查设备过滤器
+      if (!passDeviceFilter(view_config.device_matcher, device_name)) {
+        LOG_DEBUG("    设备过滤器未通过，跳过");
+        view_state.blocks_device_skipped++;
         continue;
       }
-      if (!passTrackFilter(view_config.track_filter, func.name())) {
+
+      // 检查是否已经为该设备创建了 track，如果没有则创建
+      auto it = view_state.device_track_map.find(device_name);
+      if (it != view_state.device_track_map.end()) {
+        // 复用已创建的 track
+        view_state.device_track = it->second;
+      } else {
+        // 创建新的 device track
+        view_state.device_track = perfetto_wrapper_.createNamedTrack(
+            "device_" + device_name, "Device: " + device_name, 
+            *view_state.view_track, 0, false);
+        view_state.device_track_map[device_name] = view_state.device_track;
+        LOG_DEBUG("    创建新的 device track: " << device_name);
+      }
+
+      bool mode_matched =
+          ((view_config.mode == "pipe" || view_config.mode == "line" ||
+            view_config.mode == "line_packed") && has_instructions) ||
+          (view_config.mode == "func" && has_functions) ||
+          (view_config.mode == "cnt" && has_counters);
+      if (!mode_matched) {
+        // 模式不匹配或数据类型不匹配
+        LOG_DEBUG("    警告：模式 " << view_config.mode << " 与数据类型不匹配");
+        view_state.blocks_mode_mismatched++;
         continue;
       }
-      
-      // 使用新的 Function 格式：start_timestamp 和 end_timestamp
-      if (passTimelineFilter(view_config.timeline_filter, 
-                             func.start_timestamp(), func.end_timestamp()) &&
-          passEventFilter(view_config.event_filter, func.name())) {
-        auto *new_func = filtered_batch.add_functions();
-        new_func->CopyFrom(func);
+
+      // 数据块整体与时间线过滤区间无交集时直接跳过（device track 仍按原样创建）
+      if (view_config.timeline.excludes(block_span)) {
+        LOG_DEBUG("    数据块时间范围 [" << block_span.start << ", " << block_span.end
+                  << "] 不在时间线过滤范围内，跳过");
+        view_state.blocks_timeline_skipped++;
+        continue;
       }
+      view_state.check_timeline = !view_config.timeline.covers(block_span);
+
+      view_state.filtered_insts.clear();
+      view_state.filtered_funcs.clear();
+      view_state.filtered_cnts.clear();
+      view_state.blocks_processed++;
+      active_views.push_back(&view_state);
     }
-    
-    if (filtered_batch.functions_size() > 0) {
-      processFuncMode(filtered_batch, *device_track, device_name);
+    if (active_views.empty()) {
+      continue;
     }
-    
-  } else if (view_config.mode == "cnt" && perf_data.has_counters()) {
-    std::cout << "    处理 cnt 模式，共有 " << perf_data.counters().counters_size() << " 个计数器" << std::endl;
-    auto &batch_counter = perf_data.counters();
-    unified_perf_format::BatchCounter filtered_batch;
-    
-    for (const auto &cnt : batch_counter.counters()) {
-      // 应用所有可用的过滤器
-      if (!passTrackFilter(view_config.track_filter, cnt.name())) {
-        continue;
-      }
-      if (!passEventFilter(view_config.event_filter, cnt.name())) {
-        continue;
+
+    // 每条记录只访问一次，依次分发到所有匹配的视图
+    // 所有字段都已在读取时转换为列，这里只按下标访问，不做字符串操作
+    if (has_instructions) {
+      uint32_t inst_count = static_cast<uint32_t>(block.instCount());
+      for (uint32_t i = 0; i < inst_count; i++) {
+        for (auto *view_state : active_views) {
+          filterInstruction(*view_state->config, view_state->name_bits, store, block, i,
+                            view_state->filtered_insts, view_state->check_timeline);
+        }
       }
-      
-      unified_perf_format::Counter filtered_cnt;
-      filtered_cnt.CopyFrom(cnt);
-      filtered_cnt.clear_values();
-      
-      for (const auto &value : cnt.values()) {
-        if (passTimelineFilter(view_config.timeline_filter, 
-                               value.timestamp(), value.timestamp())) {
-          auto *new_value = filtered_cnt.add_values();
-          new_value->CopyFrom(value);
+    } else if (has_functions) {
+      uint32_t func_count = static_cast<uint32_t>(block.funcCount());
+      for (uint32_t i = 0; i < func_count; i++) {
+        for (auto *view_state : active_views) {
+          filterFunction(*view_state->config, view_state->name_bits, store, block, i,
+                         view_state->filtered_funcs, view_state->check_timeline);
         }
       }
-      
-      if (filtered_cnt.values_size() > 0) {
-        auto *new_cnt = filtered_batch.add_counters();
-        new_cnt->CopyFrom(filtered_cnt);
+    } else if (has_counters) {
+      uint32_t cnt_count = static_cast<uint32_t>(block.cntCount());
+      for (uint32_t i = 0; i < cnt_count; i++) {
+        for (auto *view_state : active_views) {
+          filterCounter(*view_state->config, view_state->name_bits, store, block, i,
+                        view_state->filtered_cnts, view_state->check_timeline);
+        }
       }
     }
-    
-    if (filtered_batch.counters_size() > 0) {
-      processCntMode(filtered_batch, *device_track);
+
+    // 根据 mode 输出各视图的过滤结果
+    for (auto *view_state : active_views) {
+      const std::string &mode = view_state->config->mode;
+      auto &device_track = *view_state->device_track;
+      if (mode == "pipe") {
+        LOG_DEBUG("    pipe 模式过滤后剩余 " << view_state->filtered_insts.insts.size()
+                  << " 个有效指令");
+        if (!view_state->filtered_insts.empty()) {
+          processPipMode(store, block, view_state->filtered_insts, device_track,
+                         *view_state->config);
+        }
+      } else if (mode == "line") {
+        if (!view_state->filtered_insts.empty()) {
+          processLineMode(store, block, view_state->filtered_insts, device_track,
+                          *view_state->config);
+        }
+      } else if (mode == "line_packed") {
+        if (!view_state->filtered_insts.empty()) {
+          processLinePackedMode(store, block, view_state->filtered_insts, device_track,
+                                *view_state->config, view_state->lane_pools[device_name]);
+        }
+      } else if (mode == "func") {
+        if (!view_state->filtered_funcs.empty()) {
+          processFuncMode(store, block, view_state->filtered_funcs, device_track,
+                          *view_state->config);
+        }
+      } else if (mode == "cnt") {
+        if (!view_state->filtered_cnts.empty()) {
+          processCntMode(store, block, view_state->filtered_cnts, device_track);
+        }
+      }
+      view_state->records_emitted += view_state->filtered_insts.insts.size() +
+                                     view_state->filtered_funcs.functions.size() +
+                                     view_state->filtered_cnts.counters.size();
+      view_state->events_emitted += view_state->filtered_insts.stages.size() +
+                                    view_state->filtered_funcs.functions.size() +
+                                    view_state->filtered_cnts.sampleCount();
     }
-  } else {
-    // 模式不匹配或数据类型不匹配
-    std::cout << "    警告：模式 " << view_config.mode << " 与数据类型不匹配" << std::endl;
-    std::cout << "      mode=" << view_config.mode 
-              << ", has_instructions=" << perf_data.has_instructions()
-              << ", has_functions=" << perf_data.has_functions()
-              << ", has_counters=" << perf_data.has_counters() << std::endl;
   }
+
+  for (const auto &view_state : view_states) {
+    LOG_INFO("视图（模式 " << view_state.config->mode << "）: 处理 " << view_state.blocks_processed
+             << " 个数据块，跳过 " << view_state.blocks_device_skipped << " 个（设备不匹配）、"
+             << view_state.blocks_mode_mismatched << " 个（数据类型不匹配）、"
+             << view_state.blocks_timeline_skipped << " 个（时间线不相交），输出 "
+             << view_state.records_emitted << " 条记录、" << view_state.events_emitted
+             << " 个事件，device track " << view_state.device_track_map.size() << " 个");
   }
 }
+
 std::string PerfShower::show(const std::string &show_json_path) {
   std::string output_path;
   
   if (!initialized_) {
-    std::cerr << "错误：请先调用 init() 初始化" << std::endl;
+    LOG_ERROR("错误：请先调用 init() 初始化");
     return output_path;
   }
 
   auto json_config = parseShowJson(show_json_path);
   if (json_config.views.empty()) {
-    std::cerr << "错误：没有找到有效的视图配置" << std::endl;
+    LOG_ERROR("错误：没有找到有效的视图配置");
     return output_path;
   }
 
@@ -779,20 +1496,30 @@ std::string PerfShower::show(const std::string &show_json_path) {
     role_config_ = loadRoleConfig(json_config.role_path);
   }
 
+  // thread_filter 可以引用 role 中的线程名称，需要在加载 role 配置之后编译
+  for (auto &view_entry : json_config.views) {
+    auto &view_config = view_entry.second;
+    std::vector<std::string> thread_rules;
+    for (const auto &rule : view_config.thread_filter) {
+      thread_rules.push_back(rule.value);
+    }
+    view_config.thread.compile(thread_rules, role_config_.thread_name_map);
+  }
+
   // 从 JSON 配置中读取 filelist
   std::vector<std::string> final_file_paths;
   if (!json_config.filelist.empty()) {
     final_file_paths = json_config.filelist;
-    std::cout << "使用 JSON 配置中的 filelist，共 " << final_file_paths.size() << " 个文件" << std::endl;
+    LOG_INFO("使用 JSON 配置中的 filelist，共 " << final_file_paths.size() << " 个文件");
   } else {
-    std::cerr << "错误：JSON 配置文件中未指定 'filelist' 字段" << std::endl;
-    std::cerr << "请在 JSON 配置文件中添加 'filelist' 字段，例如：" << std::endl;
-    std::cerr << "  \"filelist\": [\"file1.bin\", \"file2.bin\"]" << std::endl;
+    LOG_ERROR("错误：JSON 配置文件中未指定 'filelist' 字段");
+    LOG_ERROR("请在 JSON 配置文件中添加 'filelist' 字段，例如：");
+    LOG_ERROR("  \"filelist\": [\"file1.bin\", \"file2.bin\"]");
     return output_path;
   }
 
   if (final_file_paths.empty()) {
-    std::cerr << "错误：JSON 配置中的 'filelist' 字段为空" << std::endl;
+    LOG_ERROR("错误：JSON 配置中的 'filelist' 字段为空");
     return output_path;
   }
 
@@ -800,38 +1527,71 @@ std::string PerfShower::show(const std::string &show_json_path) {
   if (!json_config.output.empty()) {
     output_path = json_config.output;
   } else {
-    std::cerr << "错误：JSON 配置文件中未指定 'output' 字段" << std::endl;
-    std::cerr << "请在 JSON 配置文件中添加 'output' 字段，例如：" << std::endl;
-    std::cerr << "  \"output\": \"data/test.perfetto\"" << std::endl;
+    LOG_ERROR("错误：JSON 配置文件中未指定 'output' 字段");
+    LOG_ERROR("请在 JSON 配置文件中添加 'output' 字段，例如：");
+    LOG_ERROR("  \"output\": \"data/test.perfetto\"");
     return output_path;
   }
 
-  // 从多个文件读取性能数据并合并
-  auto perf_data_list = readPerfDataFromFiles(final_file_paths);
-  if (perf_data_list.empty()) {
-    std::cerr << "错误：未能从文件读取到任何数据" << std::endl;
+  // 启动追踪后端，命令行 --backend 优先于 JSON 配置
+  std::string backend = !backend_.empty() ? backend_ : json_config.backend;
+  if (backend == "stream") {
+    if (!perfetto_wrapper_.startStream(output_path)) {
+      output_path.clear();
+      return output_path;
+    }
+    LOG_INFO("使用流式后端直接写入: " << output_path);
+  } else {
+    if (!backend.empty() && backend != "sdk") {
+      LOG_WARN("警告：未知的 backend \"" << backend << "\"，使用 sdk 后端");
+    }
+    perfetto_wrapper_.start(buf_size_kb_, output_path);
+  }
+
+  // 从多个文件读取性能数据并合并，命令行 --jobs 优先于 JSON 配置
+  int jobs = jobs_ > 0 ? jobs_ : json_config.jobs;
+  auto store = readPerfDataFromFiles(final_file_paths, jobs);
+  if (store.blocks.empty()) {
+    LOG_ERROR("错误：未能从文件读取到任何数据");
     return output_path;
   }
+  worker_pool_ = std::make_unique<ThreadPool>(ThreadPool::resolveJobs(jobs, SIZE_MAX));
 
   auto &system_track = perfetto_wrapper_.getSystemTrack();
   int view_rank = 0;
 
-  // 处理每个视图，为每个 view 创建一个独立的 track
-  for (auto it = json_config.views.begin(); it != json_config.views.end(); ++it) {
-    const std::string &view_name = it->first;
-    const ViewConfig &view_config = it->second;
-    
-    std::cout << "处理视图: " << view_name << ", 模式: " << view_config.mode << std::endl;
-    
-    // 为每个 view 创建一个 track，view_name 作为 track 名称
-    auto view_track = perfetto_wrapper_.createNamedTrack(
-        "view_" + view_name, view_name, system_track, view_rank++, false);
-    
-    // 在该 view 的 track 下处理数据（使用已读取的数据）
-    processDataWithView(view_config, perf_data_list, *view_track);
-    std::cout << "视图 " << view_name << " 处理完成" << std::endl;
+  if (json_config.fused_views) {
+    // 融合模式：先按视图顺序创建所有 view track（层级与逐视图处理完全相同），
+    // 再对数据只遍历一次，同时处理所有视图
+    std::vector<std::shared_ptr<perfetto::NamedTrack>> view_track_holders;
+    std::vector<const ViewConfig *> view_configs;
+    std::vector<perfetto::Track *> view_tracks;
+    for (auto it = json_config.views.begin(); it != json_config.views.end(); ++it) {
+      LOG_INFO("处理视图: " << it->first << ", 模式: " << it->second.mode);
+      view_track_holders.push_back(perfetto_wrapper_.createNamedTrack(
+          "view_" + it->first, it->first, system_track, view_rank++, false));
+      view_configs.push_back(&it->second);
+      view_tracks.push_back(view_track_holders.back().get());
+    }
+    processDataWithViews(view_configs, store, view_tracks);
+  } else {
+    // 处理每个视图，为每个 view 创建一个独立的 track
+    for (auto it = json_config.views.begin(); it != json_config.views.end(); ++it) {
+      const std::string &view_name = it->first;
+      const ViewConfig &view_config = it->second;
+      
+      LOG_INFO("处理视图: " << view_name << ", 模式: " << view_config.mode);
+      
+      // 为每个 view 创建一个 track，view_name 作为 track 名称
+      auto view_track = perfetto_wrapper_.createNamedTrack(
+          "view_" + view_name, view_name, system_track, view_rank++, false);
+      
+      // 在该 view 的 track 下处理数据（使用已读取的数据）
+      processDataWithView(view_config, store, *view_track);
+      LOG_INFO("视图 " << view_name << " 处理完成");
+    }
   }
 
-  std::cout << "所有视图处理完成，准备返回输出路径: " << output_path << std::endl;
+  LOG_INFO("所有视图处理完成，准备返回输出路径: " << output_path);
   return output_path;
 }
\ No newline at end of file
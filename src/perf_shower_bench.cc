@@ -0,0 +1,130 @@
+#include "logger.hh"
+#include "perfetto_wrapper.hh"
+#include "string_interner.hh"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+/**
+ * 对比 SDK 后端与流式后端的写入性能
+ *
+ * 两个后端写入相同的合成数据：tracks 条轨道，每条轨道 events 个事件，
+ * 每个事件带 metadata 个 debug annotation，最后各写一个输出文件。
+ * 输出耗时、吞吐和进程的峰值 RSS；为了让峰值 RSS 可比，每次运行只测一个后端。
+ */
+
+namespace {
+
+struct BenchOptions {
+  std::string backend = "stream";
+  std::string output = "bench.perfetto";
+  int tracks = 64;
+  int events = 100000;
+  int metadata = 4;
+};
+
+long peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void printUsage(const char *prog) {
+  std::cout << "用法: " << prog << " [选项]" << std::endl;
+  std::cout << "选项:" << std::endl;
+  std::cout << "  --backend <name>   sdk 或 stream (默认: stream)" << std::endl;
+  std::cout << "  --output <file>    输出文件路径 (默认: bench.perfetto)" << std::endl;
+  std::cout << "  --tracks <n>       轨道数 (默认: 64)" << std::endl;
+  std::cout << "  --events <n>       每条轨道的事件数 (默认: 100000)" << std::endl;
+  std::cout << "  --metadata <n>     每个事件的 metadata 数 (默认: 4)" << std::endl;
+}
+
+bool parseArgs(int argc, char *argv[], BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--backend") == 0 && has_value) {
+      options.backend = argv[++i];
+    } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+      options.output = argv[++i];
+    } else if (strcmp(argv[i], "--tracks") == 0 && has_value) {
+      options.tracks = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--events") == 0 && has_value) {
+      options.events = std::atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--metadata") == 0 && has_value) {
+      options.metadata = std::atoi(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return (options.backend == "sdk" || options.backend == "stream") &&
+         options.tracks > 0 && options.events > 0 && options.metadata >= 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  BenchOptions options;
+  if (!parseArgs(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  Logger::instance().setLevel(LogLevel::kWarn);
+
+  // metadata 与主程序一样以驻留 ID 的键值对传入
+  StringInterner strings;
+  std::vector<uint32_t> common_keys = {strings.intern("device")};
+  std::vector<uint32_t> common_values = {strings.intern("xpu0")};
+  MetadataSpan common_metadata{&strings, common_keys.data(), common_values.data(), 1};
+  std::vector<std::vector<uint32_t>> pool_keys(16);
+  std::vector<std::vector<uint32_t>> pool_values(16);
+  std::vector<MetadataSpan> metadata_pool(16);
+  for (size_t i = 0; i < metadata_pool.size(); i++) {
+    for (int k = 0; k < options.metadata; k++) {
+      pool_keys[i].push_back(strings.intern("key" + std::to_string(k)));
+      pool_values[i].push_back(strings.intern("value_" + std::to_string(i * 31 + k)));
+    }
+    metadata_pool[i] = MetadataSpan{&strings, pool_keys[i].data(), pool_values[i].data(),
+                                    pool_keys[i].size()};
+  }
+  const std::string names[] = {"fetch", "decode", "issue", "execute", "commit"};
+
+  auto begin = std::chrono::steady_clock::now();
+
+  PerfettoWrapper wrapper;
+  if (options.backend == "stream") {
+    if (!wrapper.startStream(options.output)) {
+      return 1;
+    }
+  } else {
+    wrapper.start(128 * 1024, options.output);
+  }
+
+  std::vector<std::shared_ptr<perfetto::NamedTrack>> tracks;
+  for (int t = 0; t < options.tracks; t++) {
+    tracks.push_back(wrapper.createNamedTrack("bench_" + std::to_string(t), "track " + std::to_string(t),
+                                              wrapper.getSystemTrack(), t, false));
+  }
+  for (int e = 0; e < options.events; e++) {
+    uint64_t start_cycle = static_cast<uint64_t>(e) * 10;
+    for (int t = 0; t < options.tracks; t++) {
+      wrapper.addTraceEvent(names[(e + t) % 5], *tracks[t], start_cycle, start_cycle + 8,
+                            {common_metadata, metadata_pool[(e + t) % metadata_pool.size()]});
+    }
+  }
+  wrapper.end(options.output);
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  uint64_t total = static_cast<uint64_t>(options.tracks) * options.events;
+  std::cout << "backend=" << options.backend << " events=" << total
+            << " time=" << seconds << "s"
+            << " rate=" << static_cast<uint64_t>(total / seconds) << " events/s"
+            << " peak_rss=" << peakRssKb() << "KB" << std::endl;
+
+  Logger::instance().flush();
+  return 0;
+}
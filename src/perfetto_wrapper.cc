@@ -1,36 +1,123 @@
 #include "perfetto_wrapper.hh"
+#include "logger.hh"
+#include "view_filters.hh"
 #include <cstdio>
+#include <fcntl.h>
 #include <fstream>
-#include <iostream>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
+namespace {
+
+// 按字符串内容驻留的事件名、debug annotation 名称和字符串值。
+// SDK 自带的 InternedEventName / InternedDebugAnnotationName 以 const char* 指针为键，
+// 只适用于静态字符串；这里的名称来自输入数据，需要按内容去重
+struct InternedDynamicEventName
+    : public perfetto::TrackEventInternedDataIndex<
+          InternedDynamicEventName,
+          perfetto::protos::pbzero::InternedData::kEventNamesFieldNumber,
+          std::string, perfetto::BigInternedDataTraits> {
+  static void Add(perfetto::protos::pbzero::InternedData *interned_data, size_t iid,
+                  const std::string &name) {
+    auto *entry = interned_data->add_event_names();
+    entry->set_iid(iid);
+    entry->set_name(name.data(), name.size());
+  }
+};
+
+struct InternedAnnotationName
+    : public perfetto::TrackEventInternedDataIndex<
+          InternedAnnotationName,
+          perfetto::protos::pbzero::InternedData::kDebugAnnotationNamesFieldNumber,
+          std::string, perfetto::BigInternedDataTraits> {
+  static void Add(perfetto::protos::pbzero::InternedData *interned_data, size_t iid,
+                  const std::string &name) {
+    auto *entry = interned_data->add_debug_annotation_names();
+    entry->set_iid(iid);
+    entry->set_name(name.data(), name.size());
+  }
+};
+
+struct InternedAnnotationValue
+    : public perfetto::TrackEventInternedDataIndex<
+          InternedAnnotationValue,
+          perfetto::protos::pbzero::InternedData::kDebugAnnotationStringValuesFieldNumber,
+          std::string, perfetto::BigInternedDataTraits> {
+  static void Add(perfetto::protos::pbzero::InternedData *interned_data, size_t iid,
+                  const std::string &value) {
+    auto *entry = interned_data->add_debug_annotation_string_values();
+    entry->set_iid(iid);
+    entry->set_str(value.data(), value.size());
+  }
+};
+
+// 事件名和 metadata 都通过 iid 引用，每个字符串在每个写入序列中只写一次
+void fillInternedEvent(perfetto::EventContext &ctx, const std::string &title_name,
+                       std::initializer_list<MetadataSpan> metadata,
+                       const MetadataKeyFilter *key_filter) {
+  ctx.event()->set_name_iid(InternedDynamicEventName::Get(&ctx, title_name));
+  for (const auto &span : metadata) {
+    for (size_t i = 0; i < span.size; i++) {
+      if (key_filter && !key_filter->pass(span.key(i))) {
+        continue;
+      }
+      auto *da = ctx.event()->add_debug_annotations();
+      da->set_name_iid(InternedAnnotationName::Get(&ctx, span.key(i)));            // 注解键
+      da->set_string_value_iid(InternedAnnotationValue::Get(&ctx, span.value(i))); // 注解值（字符串）
+    }
+  }
+}
+
+}  // namespace
+
 PerfettoWrapper::PerfettoWrapper()
-    : track_cnt_(0), flow_range_id_(0),
+    : track_cnt_(0), trace_fd_(-1),
       system_track_(perfetto::Track::Global(1)) {}
 
 PerfettoWrapper::~PerfettoWrapper() {
   if (tracing_session_) {
     perfetto::TrackEvent::Flush();
   }
+  if (trace_fd_ >= 0) {
+    close(trace_fd_);
+  }
 }
 
-void PerfettoWrapper::start(int buf_size_kb) {
+void PerfettoWrapper::start(int buf_size_kb, const std::string &perf_path) {
   perfetto::TracingInitArgs args;
   args.backends = perfetto::kInProcessBackend;
+  // 事件在一个线程中连续写入，较大的共享内存缓冲区可以减少服务线程来不及搬运时的丢弃
+  args.shmem_size_hint_kb = kShmemSizeHintKb;
   perfetto::Tracing::Initialize(args);
   perfetto::TrackEvent::Register();
 
+  if (!perf_path.empty()) {
+    trace_fd_ = open(perf_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd_ < 0) {
+      LOG_WARN("警告：无法创建文件 " << perf_path << "，改为在 end() 时一次性写出");
+    }
+  }
+
   perfetto::TraceConfig cfg;
   auto buf_cfg = cfg.add_buffers();
   buf_cfg->set_size_kb(buf_size_kb);
-  buf_cfg->set_fill_policy(perfetto::protos::gen::TraceConfig_BufferConfig::RING_BUFFER);
+  if (trace_fd_ >= 0) {
+    // 周期性地把缓冲区搬到文件中，缓冲区只需容纳一个周期内的数据；
+    // 写满时丢弃新数据而不是覆盖旧数据，丢弃会在 end() 的统计中报告
+    buf_cfg->set_fill_policy(perfetto::protos::gen::TraceConfig_BufferConfig::DISCARD);
+    cfg.set_write_into_file(true);
+    cfg.set_file_write_period_ms(kFileWritePeriodMs);
+    cfg.set_flush_period_ms(kFileWritePeriodMs);
+  } else {
+    buf_cfg->set_fill_policy(perfetto::protos::gen::TraceConfig_BufferConfig::RING_BUFFER);
+  }
 
   auto *ds_cfg = cfg.add_data_sources()->mutable_config();
   ds_cfg->set_name("track_event");
 
   tracing_session_ = perfetto::Tracing::NewTrace();
-  tracing_session_->Setup(cfg);
+  tracing_session_->Setup(cfg, trace_fd_);
   tracing_session_->StartBlocking();
 
   auto system_desc = system_track_.Serialize();
@@ -38,31 +125,100 @@ void PerfettoWrapper::start(int buf_size_kb) {
   perfetto::TrackEvent::SetTrackDescriptor(system_track_, system_desc);
 }
 
+bool PerfettoWrapper::startStream(const std::string &perf_path) {
+  auto writer = std::make_unique<TraceStreamWriter>();
+  if (!writer->open(perf_path)) {
+    return false;
+  }
+  stream_writer_ = std::move(writer);
+  stream_writer_->writeTrackDescriptor(system_track_.uuid, 0, "xpu_profiler",
+                                       TraceStreamWriter::kOrderingUnknown, 0);
+  return true;
+}
+
 void PerfettoWrapper::end(const std::string &perf_path) {
+  if (stream_writer_) {
+    uint64_t packet_cnt = stream_writer_->packetCount();
+    uint64_t bytes = stream_writer_->bytesWritten();
+    if (!stream_writer_->close()) {
+      LOG_ERROR("错误：写入追踪文件失败");
+    }
+    stream_writer_.reset();
+    LOG_INFO("Trace文件已流式写入 " << packet_cnt << " 个 packet (大小: " << bytes << " 字节)");
+    return;
+  }
+
   if (!tracing_session_) {
-    std::cerr << "错误：追踪会话未初始化，请先调用 start()" << std::endl;
+    LOG_ERROR("错误：追踪会话未初始化，请先调用 start()");
     return;
   }
 
   perfetto::TrackEvent::Flush();
+  bool lossless = reportTraceStats();
+  tracing_session_->StopBlocking();
+
+  if (trace_fd_ >= 0) {
+    // 数据已经在追踪过程中写入文件，StopBlocking() 会写出缓冲区中剩余的部分
+    off_t size = lseek(trace_fd_, 0, SEEK_END);
+    close(trace_fd_);
+    trace_fd_ = -1;
+    tracing_session_.reset();
+    LOG_INFO("Trace文件已保存为: " << perf_path << " (大小: " << size << " 字节)");
+    if (!lossless) {
+      LOG_WARN("警告：追踪缓冲区写满导致部分事件丢失，请增大缓冲区或使用 --backend stream");
+    }
+    return;
+  }
+
   std::vector<char> trace_data(tracing_session_->ReadTraceBlocking());
+  tracing_session_.reset();
 
-  std::cout << "PerfettoWrapper::end: 读取到 " << trace_data.size() << " 字节的追踪数据" << std::endl;
+  LOG_INFO("PerfettoWrapper::end: 读取到 " << trace_data.size() << " 字节的追踪数据");
 
   if (trace_data.empty()) {
-    std::cerr << "警告：追踪数据为空，可能没有事件被记录" << std::endl;
+    LOG_WARN("警告：追踪数据为空，可能没有事件被记录");
   }
 
   std::ofstream output(perf_path, std::ios::out | std::ios::binary);
   if (!output.is_open()) {
-    std::cerr << "错误：无法打开文件 " << perf_path << std::endl;
+    LOG_ERROR("错误：无法打开文件 " << perf_path);
     return;
   }
 
-  output.write(&trace_data[0], std::streamsize(trace_data.size()));
+  output.write(trace_data.data(), std::streamsize(trace_data.size()));
   output.close();
 
-  std::cout << "Trace文件已保存为: " << perf_path << " (大小: " << trace_data.size() << " 字节)" << std::endl;
+  LOG_INFO("Trace文件已保存为: " << perf_path << " (大小: " << trace_data.size() << " 字节)");
+  if (!lossless) {
+    LOG_WARN("警告：追踪缓冲区写满导致最早的事件被覆盖，请增大缓冲区或使用 --backend stream");
+  }
+}
+
+bool PerfettoWrapper::reportTraceStats() {
+  auto result = tracing_session_->GetTraceStatsBlocking();
+  if (!result.success) {
+    LOG_WARN("警告：无法获取追踪缓冲区统计");
+    return true;
+  }
+
+  perfetto::protos::gen::TraceStats stats;
+  if (!stats.ParseFromArray(result.trace_stats_data.data(), result.trace_stats_data.size())) {
+    LOG_WARN("警告：无法解析追踪缓冲区统计");
+    return true;
+  }
+
+  bool lossless = true;
+  for (const auto &buffer : stats.buffer_stats()) {
+    LOG_INFO("追踪缓冲区: 大小 " << buffer.buffer_size() << " 字节，写入 "
+             << buffer.bytes_written() << " 字节 / " << buffer.chunks_written()
+             << " 个 chunk，覆盖 " << buffer.chunks_overwritten() << " 个 chunk ("
+             << buffer.bytes_overwritten() << " 字节)，丢弃 " << buffer.chunks_discarded()
+             << " 个 chunk");
+    if (buffer.chunks_overwritten() > 0 || buffer.chunks_discarded() > 0) {
+      lossless = false;
+    }
+  }
+  return lossless;
 }
 
 std::shared_ptr<perfetto::NamedTrack> PerfettoWrapper::createNamedTrack(
@@ -72,6 +228,17 @@ std::shared_ptr<perfetto::NamedTrack> PerfettoWrapper::createNamedTrack(
   auto track = std::make_shared<perfetto::NamedTrack>(
       perfetto::DynamicString(track_name), track_cnt_++, parent_track);
 
+  if (stream_writer_) {
+    std::string show_name = set_cnt
+        ? "[" + std::to_string(track_cnt_) + "]" + track_show_name
+        : track_show_name;
+    stream_writer_->writeTrackDescriptor(track->uuid, parent_track.uuid, show_name,
+                                         TraceStreamWriter::kOrderingExplicit,
+                                         static_cast<int32_t>(rank_id));
+    LOG_TRACE("PerfettoWrapper::createNamedTrack: " << track_name << " " << track_show_name << " " << rank_id);
+    return track;
+  }
+
   auto desc = track->Serialize();
   if (set_cnt) {
     desc.set_name(
@@ -83,7 +250,7 @@ std::shared_ptr<perfetto::NamedTrack> PerfettoWrapper::createNamedTrack(
   desc.set_sibling_order_rank(rank_id);
 
   perfetto::TrackEvent::SetTrackDescriptor(*track, desc);
-  std::cout << "PerfettoWrapper::createNamedTrack: " << track_name << " " << track_show_name << " " << rank_id << std::endl;
+  LOG_TRACE("PerfettoWrapper::createNamedTrack: " << track_name << " " << track_show_name << " " << rank_id);
   return track;
 }
 
@@ -97,61 +264,76 @@ PerfettoWrapper::createCounterTrack(const std::string &name,
   // track->set_unit(perfetto::CounterTrack::Unit::UNIT_SIZE_BYTES);
   // track->set_unit_multiplier(1024);
   track->set_unit_name(unit_name.c_str());
+  if (stream_writer_) {
+    stream_writer_->writeCounterTrackDescriptor(track->uuid, parent_track.uuid, name, unit_name);
+  }
   return track;
 }
 
 void PerfettoWrapper::addCounterEvent(perfetto::CounterTrack &track,
                                       uint64_t cycle, double value) {
+  if (stream_writer_) {
+    stream_writer_->writeCounter(cycle, track.uuid, value);
+    return;
+  }
   TRACE_COUNTER("cpu.common", track, cycle, value);
 }
 
 void PerfettoWrapper::addTraceEvent(
     const std::string &title_name, perfetto::NamedTrack &track,
     uint64_t start_cycle, uint64_t end_cycle,
-    const google::protobuf::Map<std::string, std::string> &common_metadata,
-    const google::protobuf::Map<std::string, std::string> &metadata) {
+    std::initializer_list<MetadataSpan> metadata,
+    const MetadataKeyFilter *key_filter) {
+
+  if (stream_writer_) {
+    stream_writer_->writeSliceBegin(start_cycle, track.uuid, title_name, metadata, nullptr,
+                                    key_filter);
+    stream_writer_->writeSliceEnd(end_cycle, track.uuid);
+    LOG_TRACE("addTraceEvent: " << title_name << " " << start_cycle << " "
+              << end_cycle);
+    return;
+  }
 
+  // 事件名为 nullptr，由 fillInternedEvent 设置 name_iid
   TRACE_EVENT_BEGIN(
-      "cpu.common", perfetto::DynamicString(title_name), track, start_cycle,
+      "cpu.common", nullptr, track, start_cycle,
       [&](perfetto::EventContext ctx) {
-        for (const auto &pair : common_metadata) {
-          auto *da = ctx.event()->add_debug_annotations();
-          da->set_name(pair.first.c_str());          // 注解键
-          da->set_string_value(pair.second.c_str()); // 注解值（字符串）
-        }
-        for (const auto &pair : metadata) {
-          auto *da = ctx.event()->add_debug_annotations();
-          da->set_name(pair.first.c_str());          // 注解键
-          da->set_string_value(pair.second.c_str()); // 注解值（字符串）
-        }
+        fillInternedEvent(ctx, title_name, metadata, key_filter);
       });
 
   TRACE_EVENT_END("cpu.common", track, end_cycle);
-  std::cout << "addTraceEvent: " << title_name << " " << start_cycle << " "
-            << end_cycle << std::endl;
+  LOG_TRACE("addTraceEvent: " << title_name << " " << start_cycle << " "
+            << end_cycle);
 }
 
 void PerfettoWrapper::addTraceEventWithFlow(
     const std::string &title_name, perfetto::NamedTrack &track,
-    uint64_t start_cycle, uint64_t end_cycle, uint64_t flow_id,
-    const google::protobuf::Map<std::string, std::string> &common_metadata,
-    const google::protobuf::Map<std::string, std::string> &metadata) {
+    uint64_t start_cycle, uint64_t end_cycle, const EventFlows &flows,
+    std::initializer_list<MetadataSpan> metadata,
+    const MetadataKeyFilter *key_filter) {
+
+  if (stream_writer_) {
+    stream_writer_->writeSliceBegin(start_cycle, track.uuid, title_name, metadata, &flows,
+                                    key_filter);
+    stream_writer_->writeSliceEnd(end_cycle, track.uuid);
+    LOG_TRACE("addTraceEventWithFlow: " << title_name << " " << start_cycle << " "
+              << end_cycle << " out=" << flows.outgoing_count << " in=" << flows.terminating_count);
+    return;
+  }
 
+  // 与 perfetto::Flow::Global / TerminatingFlow::Global 相同，直接写入全局 flow id
   TRACE_EVENT_BEGIN(
-      "cpu.common", perfetto::DynamicString(title_name), track, start_cycle,
-      perfetto::Flow::Global(flow_id + (flow_range_id_ << 32)),
+      "cpu.common", nullptr, track, start_cycle,
       [&](perfetto::EventContext ctx) {
-        for (const auto &pair : common_metadata) {
-          auto *da = ctx.event()->add_debug_annotations();
-          da->set_name(pair.first.c_str());          // 注解键
-          da->set_string_value(pair.second.c_str()); // 注解值（字符串）
+        fillInternedEvent(ctx, title_name, metadata, key_filter);
+        for (size_t i = 0; i < flows.outgoing_count; i++) {
+          ctx.event()->add_flow_ids(flows.outgoing[i]);
         }
-        for (const auto &pair : metadata) {
-          auto *da = ctx.event()->add_debug_annotations();
-          da->set_name(pair.first.c_str());          // 注解键
-          da->set_string_value(pair.second.c_str()); // 注解值（字符串）
+        for (size_t i = 0; i < flows.terminating_count; i++) {
+          ctx.event()->add_terminating_flow_ids(flows.terminating[i]);
         }
       });
   TRACE_EVENT_END("cpu.common", track, end_cycle);
-  flow_range_id_++;
+  LOG_TRACE("addTraceEventWithFlow: " << title_name << " " << start_cycle << " "
+            << end_cycle << " out=" << flows.outgoing_count << " in=" << flows.terminating_count);
 }
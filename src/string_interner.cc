@@ -0,0 +1,17 @@
+#include "string_interner.hh"
+
+uint32_t StringInterner::intern(std::string_view str) {
+  auto it = ids_.find(str);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = static_cast<uint32_t>(strings_.size());
+  strings_.emplace_back(str);
+  ids_.emplace(std::string_view(strings_.back()), id);
+  return id;
+}
+
+uint32_t StringInterner::find(std::string_view str) const {
+  auto it = ids_.find(str);
+  return it != ids_.end() ? it->second : kInvalidId;
+}
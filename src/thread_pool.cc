@@ -0,0 +1,73 @@
+#include "thread_pool.hh"
+#include <algorithm>
+#include <cstdint>
+
+ThreadPool::ThreadPool(size_t num_threads) : pending_(0), stop_(false) {
+  if (num_threads == 0) {
+    num_threads = resolveJobs(0, SIZE_MAX);
+  }
+  workers_.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; i++) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push(std::move(task));
+    pending_++;
+  }
+  task_cv_.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &func) {
+  for (size_t i = 0; i < n; i++) {
+    submit([&func, i] { func(i); });
+  }
+  wait();
+}
+
+size_t ThreadPool::resolveJobs(int jobs, size_t max_tasks) {
+  size_t num_threads = jobs > 0 ? static_cast<size_t>(jobs)
+                                : std::thread::hardware_concurrency();
+  num_threads = std::min(num_threads, max_tasks);
+  return std::max<size_t>(num_threads, 1);
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      if (stop_ && tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_--;
+    }
+    done_cv_.notify_all();
+  }
+}
@@ -0,0 +1,313 @@
+#include "trace_store.hh"
+#include <algorithm>
+
+using namespace unified_perf_format;
+
+namespace {
+
+template <class T>
+size_t vectorBytes(const std::vector<T> &values) {
+  return values.capacity() * sizeof(T);
+}
+
+// 数据块 string_table 下标 -> 驻留 ID，表项在第一次被引用时才驻留，之后只查数组
+class StringTableRemap {
+public:
+  StringTableRemap(const google::protobuf::RepeatedPtrField<std::string> &table,
+                   StringInterner &interner)
+      : table_(table), interner_(interner), ids_(table.size(), kUnresolved), valid_(true) {}
+
+  /**
+   * 解析一个字符串：id 为 0 时驻留字符串字段 text，否则查字符串表
+   */
+  uint32_t resolve(uint32_t id, const std::string &text) {
+    if (id == 0) {
+      return interner_.intern(text);
+    }
+    if (id >= ids_.size()) {
+      valid_ = false;
+      return interner_.intern(std::string_view());
+    }
+    uint32_t &resolved = ids_[id];
+    if (resolved == kUnresolved) {
+      resolved = interner_.intern(table_.Get(static_cast<int>(id)));
+    }
+    return resolved;
+  }
+
+  void invalidate() { valid_ = false; }
+  bool valid() const { return valid_; }
+
+private:
+  static constexpr uint32_t kUnresolved = UINT32_MAX;
+
+  const google::protobuf::RepeatedPtrField<std::string> &table_;
+  StringInterner &interner_;
+  std::vector<uint32_t> ids_;
+  bool valid_;  // 遇到越界 ID 或不成对的 metadata_ids 后为 false
+};
+
+// 把一条记录的 metadata（字符串形式和字典编码形式）追加到数据块的键值列中
+template <class Record>
+void appendMetadata(const Record &record, StringTableRemap &strings, TraceBlock &block) {
+  static const std::string kEmpty;
+  for (const auto &pair : record.metadata()) {
+    block.meta_keys.push_back(strings.resolve(0, pair.first));
+    block.meta_values.push_back(strings.resolve(0, pair.second));
+  }
+  const auto &ids = record.metadata_ids();
+  for (int i = 0; i + 1 < ids.size(); i += 2) {
+    block.meta_keys.push_back(strings.resolve(ids[i], kEmpty));
+    block.meta_values.push_back(strings.resolve(ids[i + 1], kEmpty));
+  }
+  if (ids.size() % 2 != 0) {
+    strings.invalidate();
+  }
+}
+
+// 打包采样点的个数，两种值数组都为空或都不为空、个数与时间戳不一致时返回 false
+bool packedSampleCount(const Counter &cnt, size_t &count) {
+  count = cnt.sample_time_deltas_size();
+  size_t double_count = cnt.sample_values_size();
+  size_t float_count = cnt.sample_values_f32_size();
+  if (double_count > 0 && float_count > 0) {
+    return false;
+  }
+  return count == double_count + float_count;
+}
+
+// 把打包的采样点解码到数据块的采样列中：时间戳做一次前缀和，double 值整段拷贝
+void appendPackedSamples(const Counter &cnt, TraceBlock &block) {
+  const auto &deltas = cnt.sample_time_deltas();
+  size_t base = block.sample_times.size();
+  block.sample_times.resize(base + deltas.size());
+  uint64_t *times = block.sample_times.data() + base;
+  uint64_t timestamp = 0;
+  uint64_t first = UINT64_MAX;
+  uint64_t last = 0;
+  for (int i = 0; i < deltas.size(); i++) {
+    timestamp += static_cast<uint64_t>(deltas[i]);
+    times[i] = timestamp;
+    first = std::min(first, timestamp);
+    last = std::max(last, timestamp);
+  }
+  if (!deltas.empty()) {
+    block.span.extend(first, last);
+  }
+  if (cnt.sample_values_size() > 0) {
+    block.sample_values.insert(block.sample_values.end(), cnt.sample_values().begin(),
+                               cnt.sample_values().end());
+  } else {
+    block.sample_values.insert(block.sample_values.end(), cnt.sample_values_f32().begin(),
+                               cnt.sample_values_f32().end());
+  }
+}
+
+template <class Record>
+size_t metadataCount(const Record &record) {
+  return record.metadata_size() + record.metadata_ids_size() / 2;
+}
+
+uint32_t offsetOf(const std::vector<uint32_t> &values) {
+  return static_cast<uint32_t>(values.size());
+}
+
+}  // namespace
+
+size_t TraceBlock::memoryBytes() const {
+  size_t bytes = sizeof(TraceBlock) + device_name.capacity();
+  for (const auto *column : {&inst_names, &inst_threads, &inst_stage_begin, &inst_parent_begin,
+                             &inst_meta_begin, &stage_names, &stage_events, &stage_meta_begin,
+                             &func_names, &func_threads, &func_meta_begin, &cnt_names, &cnt_units,
+                             &cnt_sample_begin, &cnt_meta_begin, &meta_keys, &meta_values}) {
+    bytes += vectorBytes(*column);
+  }
+  for (const auto *column : {&inst_seqs, &parent_seqs, &stage_starts, &stage_ends, &func_starts,
+                             &func_ends, &sample_times}) {
+    bytes += vectorBytes(*column);
+  }
+  return bytes + vectorBytes(sample_values);
+}
+
+bool TraceStore::add(const UnifiedPerfData &perf_data,
+                     const google::protobuf::RepeatedPtrField<std::string> *shared_table) {
+  const auto &table = perf_data.string_table_size() > 0 || shared_table == nullptr
+                          ? perf_data.string_table()
+                          : *shared_table;
+  StringTableRemap name_ids(table, names);
+  StringTableRemap string_ids(table, strings);
+
+  blocks.emplace_back();
+  TraceBlock &block = blocks.back();
+  block.device_name = perf_data.device_name();
+
+  if (perf_data.has_instructions()) {
+    block.kind = TraceBlock::Kind::kInstructions;
+    const auto &insts = perf_data.instructions().instructions();
+    size_t stage_count = 0;
+    size_t parent_count = 0;
+    size_t meta_count = 0;
+    for (const auto &inst : insts) {
+      stage_count += inst.stages_size();
+      parent_count += inst.parent_seq_num_size();
+      meta_count += metadataCount(inst);
+      for (const auto &stage : inst.stages()) {
+        meta_count += metadataCount(stage);
+      }
+    }
+    block.inst_names.reserve(insts.size());
+    block.inst_threads.reserve(insts.size());
+    block.inst_seqs.reserve(insts.size());
+    block.inst_stage_begin.reserve(insts.size() + 1);
+    block.inst_parent_begin.reserve(insts.size() + 1);
+    block.inst_meta_begin.reserve(insts.size() + 1);
+    block.parent_seqs.reserve(parent_count);
+    block.stage_starts.reserve(stage_count);
+    block.stage_ends.reserve(stage_count);
+    block.stage_names.reserve(stage_count);
+    block.stage_events.reserve(stage_count);
+    block.stage_meta_begin.reserve(stage_count + 1);
+    block.meta_keys.reserve(meta_count);
+    block.meta_values.reserve(meta_count);
+
+    // 先写所有指令的 metadata，再写所有 stage 的 metadata，两者各自在键值列中连续
+    block.inst_stage_begin.push_back(0);
+    block.inst_parent_begin.push_back(0);
+    block.inst_meta_begin.push_back(0);
+    for (const auto &inst : insts) {
+      block.inst_names.push_back(name_ids.resolve(inst.name_id(), inst.name()));
+      block.inst_threads.push_back(inst.thread_id());
+      block.inst_seqs.push_back(inst.global_seq_num());
+      block.parent_seqs.insert(block.parent_seqs.end(), inst.parent_seq_num().begin(),
+                               inst.parent_seq_num().end());
+      block.inst_parent_begin.push_back(static_cast<uint32_t>(block.parent_seqs.size()));
+      appendMetadata(inst, string_ids, block);
+      block.inst_meta_begin.push_back(offsetOf(block.meta_keys));
+    }
+    block.stage_meta_begin.push_back(offsetOf(block.meta_keys));
+    for (const auto &inst : insts) {
+      for (const auto &stage : inst.stages()) {
+        uint32_t stage_name = name_ids.resolve(stage.name_id(), stage.name());
+        block.stage_starts.push_back(stage.start_time());
+        block.stage_ends.push_back(stage.end_time());
+        block.stage_names.push_back(stage_name);
+        bool has_title = stage.show_title_id() != 0 || !stage.show_title().empty();
+        block.stage_events.push_back(
+            has_title ? name_ids.resolve(stage.show_title_id(), stage.show_title()) : stage_name);
+        block.span.extend(stage.start_time(), stage.end_time());
+        appendMetadata(stage, string_ids, block);
+        block.stage_meta_begin.push_back(offsetOf(block.meta_keys));
+      }
+      block.inst_stage_begin.push_back(offsetOf(block.stage_names));
+    }
+  } else if (perf_data.has_functions()) {
+    block.kind = TraceBlock::Kind::kFunctions;
+    const auto &funcs = perf_data.functions().functions();
+    size_t meta_count = 0;
+    for (const auto &func : funcs) {
+      meta_count += metadataCount(func);
+    }
+    block.func_names.reserve(funcs.size());
+    block.func_threads.reserve(funcs.size());
+    block.func_starts.reserve(funcs.size());
+    block.func_ends.reserve(funcs.size());
+    block.func_meta_begin.reserve(funcs.size() + 1);
+    block.meta_keys.reserve(meta_count);
+    block.meta_values.reserve(meta_count);
+    block.func_meta_begin.push_back(0);
+    for (const auto &func : funcs) {
+      block.func_names.push_back(name_ids.resolve(func.name_id(), func.name()));
+      block.func_threads.push_back(func.thread_id());
+      block.func_starts.push_back(func.start_timestamp());
+      block.func_ends.push_back(func.end_timestamp());
+      block.span.extend(func.start_timestamp(), func.end_timestamp());
+      appendMetadata(func, string_ids, block);
+      block.func_meta_begin.push_back(offsetOf(block.meta_keys));
+    }
+  } else if (perf_data.has_counters()) {
+    block.kind = TraceBlock::Kind::kCounters;
+    const auto &cnts = perf_data.counters().counters();
+    size_t sample_count = 0;
+    size_t meta_count = 0;
+    for (const auto &cnt : cnts) {
+      size_t packed_count = 0;
+      if (!packedSampleCount(cnt, packed_count)) {
+        blocks.pop_back();
+        return false;
+      }
+      sample_count += cnt.values_size() + packed_count;
+      meta_count += metadataCount(cnt);
+    }
+    block.cnt_names.reserve(cnts.size());
+    block.cnt_units.reserve(cnts.size());
+    block.cnt_sample_begin.reserve(cnts.size() + 1);
+    block.cnt_meta_begin.reserve(cnts.size() + 1);
+    block.sample_times.reserve(sample_count);
+    block.sample_values.reserve(sample_count);
+    block.meta_keys.reserve(meta_count);
+    block.meta_values.reserve(meta_count);
+    block.cnt_sample_begin.push_back(0);
+    block.cnt_meta_begin.push_back(0);
+    for (const auto &cnt : cnts) {
+      block.cnt_names.push_back(name_ids.resolve(cnt.name_id(), cnt.name()));
+      block.cnt_units.push_back(name_ids.resolve(cnt.unit_id(), cnt.unit()));
+      for (const auto &value : cnt.values()) {
+        block.sample_times.push_back(value.timestamp());
+        block.sample_values.push_back(value.value());
+        block.span.extend(value.timestamp(), value.timestamp());
+      }
+      appendPackedSamples(cnt, block);
+      block.cnt_sample_begin.push_back(static_cast<uint32_t>(block.sample_times.size()));
+      appendMetadata(cnt, string_ids, block);
+      block.cnt_meta_begin.push_back(offsetOf(block.meta_keys));
+    }
+  }
+
+  if (!name_ids.valid() || !string_ids.valid()) {
+    blocks.pop_back();
+    return false;
+  }
+  return true;
+}
+
+void TraceStore::append(TraceStore &&other) {
+  // 局部 ID -> 全局 ID：名称只有几百个；metadata 值可能很多，但每个不同的字符串只重新驻留一次
+  std::vector<uint32_t> name_remap(other.names.size());
+  for (uint32_t id = 0; id < other.names.size(); id++) {
+    name_remap[id] = names.intern(other.names.str(id));
+  }
+  std::vector<uint32_t> string_remap(other.strings.size());
+  for (uint32_t id = 0; id < other.strings.size(); id++) {
+    string_remap[id] = strings.intern(other.strings.str(id));
+  }
+
+  blocks.reserve(blocks.size() + other.blocks.size());
+  for (auto &block : other.blocks) {
+    for (auto *ids : {&block.inst_names, &block.stage_names, &block.stage_events,
+                      &block.func_names, &block.cnt_names, &block.cnt_units}) {
+      for (auto &id : *ids) {
+        id = name_remap[id];
+      }
+    }
+    for (auto *ids : {&block.meta_keys, &block.meta_values}) {
+      for (auto &id : *ids) {
+        id = string_remap[id];
+      }
+    }
+    blocks.push_back(std::move(block));
+  }
+  other.blocks.clear();
+}
+
+size_t TraceStore::memoryBytes() const {
+  size_t bytes = 0;
+  for (const auto &block : blocks) {
+    bytes += block.memoryBytes();
+  }
+  for (const auto *table : {&names, &strings}) {
+    for (uint32_t id = 0; id < table->size(); id++) {
+      bytes += sizeof(std::string) + table->str(id).capacity();
+    }
+  }
+  return bytes;
+}
@@ -0,0 +1,383 @@
+#include "trace_stream_writer.hh"
+#include "logger.hh"
+#include "view_filters.hh"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::FileOutputStream;
+
+namespace {
+
+// perfetto/protos 中用到的字段号
+constexpr uint32_t kTracePacket = 1;                    // Trace.packet
+
+constexpr uint32_t kPacketTimestamp = 8;                // TracePacket
+constexpr uint32_t kPacketSequenceId = 10;
+constexpr uint32_t kPacketTrackEvent = 11;
+constexpr uint32_t kPacketInternedData = 12;
+constexpr uint32_t kPacketSequenceFlags = 13;
+constexpr uint32_t kPacketTrackDescriptor = 60;
+
+constexpr uint32_t kEventCategoryIids = 3;              // TrackEvent
+constexpr uint32_t kEventDebugAnnotations = 4;
+constexpr uint32_t kEventType = 9;
+constexpr uint32_t kEventNameIid = 10;
+constexpr uint32_t kEventTrackUuid = 11;
+constexpr uint32_t kEventDoubleCounterValue = 44;
+constexpr uint32_t kEventFlowIds = 47;
+constexpr uint32_t kEventTerminatingFlowIds = 48;
+
+constexpr uint32_t kAnnotationNameIid = 1;              // DebugAnnotation
+constexpr uint32_t kAnnotationStringValueIid = 17;
+
+constexpr uint32_t kInternedEventCategories = 1;        // InternedData
+constexpr uint32_t kInternedEventNames = 2;
+constexpr uint32_t kInternedAnnotationNames = 3;
+constexpr uint32_t kInternedAnnotationStringValues = 29;
+
+constexpr uint32_t kInternedEntryIid = 1;               // EventName / DebugAnnotationName / InternedString
+constexpr uint32_t kInternedEntryName = 2;
+
+constexpr uint32_t kDescriptorUuid = 1;                 // TrackDescriptor
+constexpr uint32_t kDescriptorName = 2;
+constexpr uint32_t kDescriptorParentUuid = 5;
+constexpr uint32_t kDescriptorCounter = 8;
+constexpr uint32_t kDescriptorChildOrdering = 11;
+constexpr uint32_t kDescriptorSiblingOrderRank = 12;
+
+constexpr uint32_t kCounterUnitName = 6;                // CounterDescriptor
+
+constexpr uint64_t kTypeSliceBegin = 1;                 // TrackEvent.Type
+constexpr uint64_t kTypeSliceEnd = 2;
+constexpr uint64_t kTypeCounter = 4;
+
+constexpr uint32_t kSeqIncrementalStateCleared = 1;     // TracePacket.SequenceFlags
+constexpr uint32_t kSeqNeedsIncrementalState = 2;
+constexpr uint32_t kSequenceId = 1;
+
+constexpr uint32_t kWireVarint = 0;
+constexpr uint32_t kWireFixed64 = 1;
+constexpr uint32_t kWireLengthDelimited = 2;
+
+const char kCategory[] = "cpu.common";
+constexpr size_t kCategorySize = sizeof(kCategory) - 1;
+constexpr uint64_t kCategoryIid = 1;
+
+constexpr uint32_t makeTag(uint32_t field, uint32_t wire_type) { return (field << 3) | wire_type; }
+
+size_t tagSize(uint32_t field) { return CodedOutputStream::VarintSize32(field << 3); }
+
+size_t varintFieldSize(uint32_t field, uint64_t value) {
+  return tagSize(field) + CodedOutputStream::VarintSize64(value);
+}
+
+size_t fixed64FieldSize(uint32_t field) { return tagSize(field) + 8; }
+
+size_t bytesFieldSize(uint32_t field, size_t length) {
+  return tagSize(field) + CodedOutputStream::VarintSize64(length) + length;
+}
+
+void writeVarintField(CodedOutputStream *out, uint32_t field, uint64_t value) {
+  out->WriteTag(makeTag(field, kWireVarint));
+  out->WriteVarint64(value);
+}
+
+void writeFixed64Field(CodedOutputStream *out, uint32_t field, uint64_t value) {
+  out->WriteTag(makeTag(field, kWireFixed64));
+  out->WriteLittleEndian64(value);
+}
+
+void writeBytesField(CodedOutputStream *out, uint32_t field, const char *data, size_t length) {
+  out->WriteTag(makeTag(field, kWireLengthDelimited));
+  out->WriteVarint64(length);
+  out->WriteRaw(data, static_cast<int>(length));
+}
+
+void writeLengthHeader(CodedOutputStream *out, uint32_t field, size_t length) {
+  out->WriteTag(makeTag(field, kWireLengthDelimited));
+  out->WriteVarint64(length);
+}
+
+// EventName / DebugAnnotationName / InternedString { iid, name } 的消息体长度
+size_t internedEntrySize(uint64_t iid, size_t length) {
+  return varintFieldSize(kInternedEntryIid, iid) + bytesFieldSize(kInternedEntryName, length);
+}
+
+void writeInternedEntry(CodedOutputStream *out, uint32_t field, uint64_t iid,
+                        const char *data, size_t length) {
+  writeLengthHeader(out, field, internedEntrySize(iid, length));
+  writeVarintField(out, kInternedEntryIid, iid);
+  writeBytesField(out, kInternedEntryName, data, length);
+}
+
+// DebugAnnotation { name_iid, string_value_iid } 的消息体长度
+size_t annotationSize(uint64_t name_iid, uint64_t value_iid) {
+  return varintFieldSize(kAnnotationNameIid, name_iid) +
+         varintFieldSize(kAnnotationStringValueIid, value_iid);
+}
+
+}  // namespace
+
+TraceStreamWriter::TraceStreamWriter()
+    : fd_(-1), packet_cnt_(0), first_packet_(true), category_interned_(false) {}
+
+TraceStreamWriter::~TraceStreamWriter() { close(); }
+
+bool TraceStreamWriter::open(const std::string &file_path, int buffer_size) {
+  close();
+  fd_ = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    LOG_ERROR("错误：无法创建文件 " << file_path);
+    return false;
+  }
+  file_stream_ = std::make_unique<FileOutputStream>(fd_, buffer_size);
+  coded_ = std::make_unique<CodedOutputStream>(file_stream_.get());
+  packet_cnt_ = 0;
+  first_packet_ = true;
+  category_interned_ = false;
+  event_names_ = StringInterner();
+  annotation_names_ = StringInterner();
+  annotation_values_ = StringInterner();
+  return true;
+}
+
+bool TraceStreamWriter::close() {
+  bool ok = true;
+  if (coded_) {
+    ok = !coded_->HadError();
+    coded_.reset();  // 析构时把未使用的缓冲归还给文件流
+  }
+  if (file_stream_) {
+    ok = file_stream_->Close() && ok;
+    file_stream_.reset();
+    fd_ = -1;
+  } else if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  return ok;
+}
+
+uint64_t TraceStreamWriter::bytesWritten() const {
+  return coded_ ? static_cast<uint64_t>(coded_->ByteCount()) : 0;
+}
+
+size_t TraceStreamWriter::packetFieldsSize(bool has_timestamp, uint64_t timestamp,
+                                           uint32_t sequence_flags) const {
+  size_t size = varintFieldSize(kPacketSequenceId, kSequenceId);
+  if (has_timestamp) {
+    size += varintFieldSize(kPacketTimestamp, timestamp);
+  }
+  if (first_packet_) {
+    sequence_flags |= kSeqIncrementalStateCleared;
+  }
+  if (sequence_flags != 0) {
+    size += varintFieldSize(kPacketSequenceFlags, sequence_flags);
+  }
+  return size;
+}
+
+void TraceStreamWriter::beginPacket(size_t payload_size, bool has_timestamp, uint64_t timestamp,
+                                    uint32_t sequence_flags) {
+  writeLengthHeader(coded_.get(), kTracePacket,
+                    packetFieldsSize(has_timestamp, timestamp, sequence_flags) + payload_size);
+  if (has_timestamp) {
+    writeVarintField(coded_.get(), kPacketTimestamp, timestamp);
+  }
+  writeVarintField(coded_.get(), kPacketSequenceId, kSequenceId);
+  if (first_packet_) {
+    sequence_flags |= kSeqIncrementalStateCleared;
+    first_packet_ = false;
+  }
+  if (sequence_flags != 0) {
+    writeVarintField(coded_.get(), kPacketSequenceFlags, sequence_flags);
+  }
+  packet_cnt_++;
+}
+
+uint64_t TraceStreamWriter::internString(StringInterner &table, const std::string &str,
+                                         std::vector<uint64_t> &new_iids) {
+  size_t old_size = table.size();
+  uint64_t iid = static_cast<uint64_t>(table.intern(str)) + 1;  // iid 0 表示未设置
+  if (table.size() != old_size) {
+    new_iids.push_back(iid);
+  }
+  return iid;
+}
+
+size_t TraceStreamWriter::internedEntriesSize(uint32_t field, const StringInterner &table,
+                                              const std::vector<uint64_t> &iids) const {
+  size_t size = 0;
+  for (uint64_t iid : iids) {
+    size += bytesFieldSize(field, internedEntrySize(iid, table.str(iid - 1).size()));
+  }
+  return size;
+}
+
+void TraceStreamWriter::writeInternedEntries(uint32_t field, const StringInterner &table,
+                                             const std::vector<uint64_t> &iids) {
+  for (uint64_t iid : iids) {
+    const std::string &str = table.str(iid - 1);
+    writeInternedEntry(coded_.get(), field, iid, str.data(), str.size());
+  }
+}
+
+void TraceStreamWriter::writeTrackDescriptor(uint64_t uuid, uint64_t parent_uuid,
+                                             const std::string &name,
+                                             ChildOrdering child_ordering,
+                                             int32_t sibling_order_rank) {
+  if (!coded_) return;
+  // int32 负数按 10 字节 varint 编码
+  uint64_t rank = static_cast<uint64_t>(static_cast<int64_t>(sibling_order_rank));
+  size_t body = varintFieldSize(kDescriptorUuid, uuid) +
+                bytesFieldSize(kDescriptorName, name.size()) +
+                varintFieldSize(kDescriptorChildOrdering, child_ordering) +
+                varintFieldSize(kDescriptorSiblingOrderRank, rank);
+  if (parent_uuid != 0) {
+    body += varintFieldSize(kDescriptorParentUuid, parent_uuid);
+  }
+
+  beginPacket(bytesFieldSize(kPacketTrackDescriptor, body), false, 0, 0);
+  writeLengthHeader(coded_.get(), kPacketTrackDescriptor, body);
+  writeVarintField(coded_.get(), kDescriptorUuid, uuid);
+  if (parent_uuid != 0) {
+    writeVarintField(coded_.get(), kDescriptorParentUuid, parent_uuid);
+  }
+  writeBytesField(coded_.get(), kDescriptorName, name.data(), name.size());
+  writeVarintField(coded_.get(), kDescriptorChildOrdering, child_ordering);
+  writeVarintField(coded_.get(), kDescriptorSiblingOrderRank, rank);
+}
+
+void TraceStreamWriter::writeCounterTrackDescriptor(uint64_t uuid, uint64_t parent_uuid,
+                                                    const std::string &name,
+                                                    const std::string &unit_name) {
+  if (!coded_) return;
+  size_t counter_body = bytesFieldSize(kCounterUnitName, unit_name.size());
+  size_t body = varintFieldSize(kDescriptorUuid, uuid) +
+                bytesFieldSize(kDescriptorName, name.size()) +
+                bytesFieldSize(kDescriptorCounter, counter_body);
+  if (parent_uuid != 0) {
+    body += varintFieldSize(kDescriptorParentUuid, parent_uuid);
+  }
+
+  beginPacket(bytesFieldSize(kPacketTrackDescriptor, body), false, 0, 0);
+  writeLengthHeader(coded_.get(), kPacketTrackDescriptor, body);
+  writeVarintField(coded_.get(), kDescriptorUuid, uuid);
+  if (parent_uuid != 0) {
+    writeVarintField(coded_.get(), kDescriptorParentUuid, parent_uuid);
+  }
+  writeBytesField(coded_.get(), kDescriptorName, name.data(), name.size());
+  writeLengthHeader(coded_.get(), kDescriptorCounter, counter_body);
+  writeBytesField(coded_.get(), kCounterUnitName, unit_name.data(), unit_name.size());
+}
+
+void TraceStreamWriter::writeSliceBegin(uint64_t timestamp, uint64_t track_uuid,
+                                        const std::string &name,
+                                        std::initializer_list<MetadataSpan> metadata,
+                                        const EventFlows *flows,
+                                        const MetadataKeyFilter *key_filter) {
+  if (!coded_) return;
+
+  // 驻留事件名与 metadata，本 packet 中首次出现的字符串随 interned_data 一起写出
+  new_event_names_.clear();
+  new_annotation_names_.clear();
+  new_annotation_values_.clear();
+  annotations_.clear();
+  uint64_t name_iid = internString(event_names_, name, new_event_names_);
+  for (const auto &span : metadata) {
+    for (size_t i = 0; i < span.size; i++) {
+      const std::string &key = span.key(i);
+      if (key_filter && !key_filter->pass(key)) {
+        continue;
+      }
+      annotations_.emplace_back(internString(annotation_names_, key, new_annotation_names_),
+                                internString(annotation_values_, span.value(i),
+                                             new_annotation_values_));
+    }
+  }
+
+  size_t interned = internedEntriesSize(kInternedEventNames, event_names_, new_event_names_) +
+                    internedEntriesSize(kInternedAnnotationNames, annotation_names_, new_annotation_names_) +
+                    internedEntriesSize(kInternedAnnotationStringValues, annotation_values_,
+                                        new_annotation_values_);
+  if (!category_interned_) {
+    interned += bytesFieldSize(kInternedEventCategories, internedEntrySize(kCategoryIid, kCategorySize));
+  }
+
+  size_t body = varintFieldSize(kEventType, kTypeSliceBegin) +
+                varintFieldSize(kEventTrackUuid, track_uuid) +
+                varintFieldSize(kEventCategoryIids, kCategoryIid) +
+                varintFieldSize(kEventNameIid, name_iid);
+  for (const auto &annotation : annotations_) {
+    body += bytesFieldSize(kEventDebugAnnotations, annotationSize(annotation.first, annotation.second));
+  }
+  if (flows) {
+    body += flows->outgoing_count * fixed64FieldSize(kEventFlowIds) +
+            flows->terminating_count * fixed64FieldSize(kEventTerminatingFlowIds);
+  }
+
+  size_t payload = bytesFieldSize(kPacketTrackEvent, body);
+  if (interned != 0) {
+    payload += bytesFieldSize(kPacketInternedData, interned);
+  }
+  beginPacket(payload, true, timestamp, kSeqNeedsIncrementalState);
+
+  if (interned != 0) {
+    writeLengthHeader(coded_.get(), kPacketInternedData, interned);
+    if (!category_interned_) {
+      writeInternedEntry(coded_.get(), kInternedEventCategories, kCategoryIid, kCategory, kCategorySize);
+      category_interned_ = true;
+    }
+    writeInternedEntries(kInternedEventNames, event_names_, new_event_names_);
+    writeInternedEntries(kInternedAnnotationNames, annotation_names_, new_annotation_names_);
+    writeInternedEntries(kInternedAnnotationStringValues, annotation_values_, new_annotation_values_);
+  }
+
+  writeLengthHeader(coded_.get(), kPacketTrackEvent, body);
+  writeVarintField(coded_.get(), kEventType, kTypeSliceBegin);
+  writeVarintField(coded_.get(), kEventTrackUuid, track_uuid);
+  writeVarintField(coded_.get(), kEventCategoryIids, kCategoryIid);
+  writeVarintField(coded_.get(), kEventNameIid, name_iid);
+  for (const auto &annotation : annotations_) {
+    writeLengthHeader(coded_.get(), kEventDebugAnnotations,
+                      annotationSize(annotation.first, annotation.second));
+    writeVarintField(coded_.get(), kAnnotationNameIid, annotation.first);
+    writeVarintField(coded_.get(), kAnnotationStringValueIid, annotation.second);
+  }
+  if (flows) {
+    for (size_t i = 0; i < flows->outgoing_count; i++) {
+      writeFixed64Field(coded_.get(), kEventFlowIds, flows->outgoing[i]);
+    }
+    for (size_t i = 0; i < flows->terminating_count; i++) {
+      writeFixed64Field(coded_.get(), kEventTerminatingFlowIds, flows->terminating[i]);
+    }
+  }
+}
+
+void TraceStreamWriter::writeSliceEnd(uint64_t timestamp, uint64_t track_uuid) {
+  if (!coded_) return;
+  size_t body = varintFieldSize(kEventType, kTypeSliceEnd) +
+                varintFieldSize(kEventTrackUuid, track_uuid);
+
+  beginPacket(bytesFieldSize(kPacketTrackEvent, body), true, timestamp, kSeqNeedsIncrementalState);
+  writeLengthHeader(coded_.get(), kPacketTrackEvent, body);
+  writeVarintField(coded_.get(), kEventType, kTypeSliceEnd);
+  writeVarintField(coded_.get(), kEventTrackUuid, track_uuid);
+}
+
+void TraceStreamWriter::writeCounter(uint64_t timestamp, uint64_t track_uuid, double value) {
+  if (!coded_) return;
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  size_t body = varintFieldSize(kEventType, kTypeCounter) +
+                varintFieldSize(kEventTrackUuid, track_uuid) +
+                fixed64FieldSize(kEventDoubleCounterValue);
+
+  beginPacket(bytesFieldSize(kPacketTrackEvent, body), true, timestamp, kSeqNeedsIncrementalState);
+  writeLengthHeader(coded_.get(), kPacketTrackEvent, body);
+  writeVarintField(coded_.get(), kEventType, kTypeCounter);
+  writeVarintField(coded_.get(), kEventTrackUuid, track_uuid);
+  writeFixed64Field(coded_.get(), kEventDoubleCounterValue, bits);
+}
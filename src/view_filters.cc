@@ -0,0 +1,344 @@
+#include "view_filters.hh"
+#include "logger.hh"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <queue>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 解析无符号整数，要求整个字符串都是数字
+static bool parseUint64(const std::string &text, uint64_t &value) {
+  if (text.empty() || text.size() > 20) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    uint64_t digit = static_cast<uint64_t>(c - '0');
+    if (result > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  value = result;
+  return true;
+}
+
+void TimelineFilter::compile(const std::vector<std::string> &rules) {
+  enabled_ = !rules.empty();
+  intervals_.clear();
+
+  for (const auto &rule : rules) {
+    // 解析时间范围，格式: "start-end" 或单个时间戳（等价于 [t, t]）
+    uint64_t filter_start = 0;
+    uint64_t filter_end = 0;
+    size_t dash_pos = rule.find('-');
+    bool ok;
+    if (dash_pos != std::string::npos) {
+      ok = parseUint64(rule.substr(0, dash_pos), filter_start) &&
+           parseUint64(rule.substr(dash_pos + 1), filter_end) &&
+           filter_start <= filter_end;
+    } else {
+      ok = parseUint64(rule, filter_start);
+      filter_end = filter_start;
+    }
+    if (!ok) {
+      LOG_WARN("警告：忽略非法的 timeline_filter 规则 \"" << rule << "\"");
+      continue;
+    }
+    intervals_.emplace_back(filter_start, filter_end);
+  }
+
+  // 排序后合并重叠或相邻的区间（整数闭区间 [a, b] 与 [b + 1, c] 可以合并）
+  std::sort(intervals_.begin(), intervals_.end());
+  std::vector<std::pair<uint64_t, uint64_t>> merged;
+  for (const auto &interval : intervals_) {
+    if (!merged.empty() &&
+        (merged.back().second == UINT64_MAX || interval.first <= merged.back().second + 1)) {
+      merged.back().second = std::max(merged.back().second, interval.second);
+    } else {
+      merged.push_back(interval);
+    }
+  }
+  intervals_.swap(merged);
+}
+
+bool TimelineFilter::overlaps(uint64_t start_time, uint64_t end_time) const {
+  // 区间互不相交且有序，终点同样有序：找到第一个终点 >= start_time 的区间，
+  // 重叠条件为 start_time <= filter_end && end_time >= filter_start
+  auto it = std::lower_bound(
+      intervals_.begin(), intervals_.end(), start_time,
+      [](const std::pair<uint64_t, uint64_t> &interval, uint64_t t) {
+        return interval.second < t;
+      });
+  return it != intervals_.end() && it->first <= end_time;
+}
+
+bool TimelineFilter::covers(const TimeSpan &span) const {
+  if (!enabled_) return true;
+  if (span.empty()) return false;
+  auto it = std::lower_bound(
+      intervals_.begin(), intervals_.end(), span.start,
+      [](const std::pair<uint64_t, uint64_t> &interval, uint64_t t) {
+        return interval.second < t;
+      });
+  return it != intervals_.end() && it->first <= span.start && it->second >= span.end;
+}
+
+void SubstringMatcher::compile(const std::vector<std::string> &patterns) {
+  enabled_ = !patterns.empty();
+  match_all_ = false;
+  class_count_ = 1;
+  std::memset(byte_class_, 0, sizeof(byte_class_));
+  transitions_.clear();
+  accept_.clear();
+  first_bytes_.clear();
+  cache_.clear();
+
+  for (const auto &pattern : patterns) {
+    // 空串是任意名称的子串，与 std::string::find("") 的行为一致
+    if (pattern.empty()) {
+      match_all_ = true;
+    }
+    for (unsigned char c : pattern) {
+      if (byte_class_[c] == 0) {
+        byte_class_[c] = static_cast<uint8_t>(class_count_++);
+      }
+    }
+  }
+  if (!enabled_ || match_all_) {
+    return;
+  }
+
+  // 构建 trie，状态 0 为根
+  std::vector<std::vector<uint32_t>> children(1, std::vector<uint32_t>(class_count_, 0));
+  accept_.assign(1, 0);
+  bool has_first[256] = {};
+  for (const auto &pattern : patterns) {
+    uint32_t state = 0;
+    for (unsigned char c : pattern) {
+      uint32_t cls = byte_class_[c];
+      if (children[state][cls] == 0) {
+        children[state][cls] = static_cast<uint32_t>(children.size());
+        children.emplace_back(class_count_, 0);
+        accept_.push_back(0);
+      }
+      state = children[state][cls];
+    }
+    accept_[state] = 1;
+    unsigned char first = static_cast<unsigned char>(pattern[0]);
+    if (!has_first[first]) {
+      has_first[first] = true;
+      first_bytes_.push_back(first);
+    }
+  }
+  if (first_bytes_.size() > kMaxPrefilterBytes) {
+    first_bytes_.clear();
+  }
+
+  // BFS 计算失败链接，并把 trie 补全为完整的转移表（DFA）
+  size_t state_count = children.size();
+  std::vector<uint32_t> fail(state_count, 0);
+  transitions_.assign(state_count * class_count_, 0);
+  std::queue<uint32_t> queue;
+  for (uint32_t cls = 0; cls < class_count_; cls++) {
+    uint32_t next = children[0][cls];
+    transitions_[cls] = next;
+    if (next != 0) {
+      queue.push(next);
+    }
+  }
+  while (!queue.empty()) {
+    uint32_t state = queue.front();
+    queue.pop();
+    accept_[state] |= accept_[fail[state]];
+    for (uint32_t cls = 0; cls < class_count_; cls++) {
+      uint32_t next = children[state][cls];
+      if (next != 0) {
+        fail[next] = transitions_[fail[state] * class_count_ + cls];
+        transitions_[state * class_count_ + cls] = next;
+        queue.push(next);
+      } else {
+        transitions_[state * class_count_ + cls] =
+            transitions_[fail[state] * class_count_ + cls];
+      }
+    }
+  }
+}
+
+size_t SubstringMatcher::findCandidate(const char *data, size_t size) const {
+  if (first_bytes_.empty()) {
+    return 0;
+  }
+  size_t pos = 0;
+#if defined(__SSE2__)
+  __m128i needles[kMaxPrefilterBytes];
+  for (size_t k = 0; k < first_bytes_.size(); k++) {
+    needles[k] = _mm_set1_epi8(static_cast<char>(first_bytes_[k]));
+  }
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    __m128i hit = _mm_cmpeq_epi8(block, needles[0]);
+    for (size_t k = 1; k < first_bytes_.size(); k++) {
+      hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, needles[k]));
+    }
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+  }
+#endif
+  for (; pos < size; pos++) {
+    unsigned char c = static_cast<unsigned char>(data[pos]);
+    for (uint8_t first : first_bytes_) {
+      if (c == first) {
+        return pos;
+      }
+    }
+  }
+  return size;
+}
+
+bool SubstringMatcher::scan(const char *data, size_t size) const {
+  // 任何匹配都不可能在第一个候选首字节之前开始，自动机从候选位置以根状态启动即可
+  size_t pos = findCandidate(data, size);
+  uint32_t state = 0;
+  for (; pos < size; pos++) {
+    state = transitions_[state * class_count_ + byte_class_[static_cast<unsigned char>(data[pos])]];
+    if (accept_[state]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SubstringMatcher::matches(const std::string &name) const {
+  if (!enabled_ || match_all_) {
+    return true;
+  }
+  auto it = cache_.find(name);
+  if (it != cache_.end()) {
+    return it->second;
+  }
+  bool result = scan(name.data(), name.size());
+  if (cache_.size() < kMaxCacheEntries) {
+    cache_.emplace(name, result);
+  }
+  return result;
+}
+
+void NameBitset::build(const SubstringMatcher &matcher, const StringInterner &names) {
+  all_ = !matcher.enabled();
+  words_.clear();
+  if (all_) {
+    return;
+  }
+  words_.assign((names.size() + 63) / 64, 0);
+  for (uint32_t id = 0; id < names.size(); id++) {
+    if (matcher.matches(names.str(id))) {
+      words_[id >> 6] |= uint64_t(1) << (id & 63);
+    }
+  }
+}
+
+void ThreadFilter::compile(const std::vector<std::string> &rules,
+                           const std::unordered_map<uint32_t, std::string> &thread_names) {
+  enabled_ = !rules.empty();
+  bits_.clear();
+  sparse_.clear();
+
+  for (const auto &rule : rules) {
+    // 线程ID 或 "first-last" 区间
+    uint64_t first = 0;
+    uint64_t last = 0;
+    size_t dash_pos = rule.find('-');
+    bool numeric;
+    if (dash_pos != std::string::npos) {
+      numeric = parseUint64(rule.substr(0, dash_pos), first) &&
+                parseUint64(rule.substr(dash_pos + 1), last);
+    } else {
+      numeric = parseUint64(rule, first);
+      last = first;
+    }
+    if (numeric) {
+      if (first > last || last > UINT32_MAX) {
+        LOG_WARN("警告：忽略非法的 thread_filter 规则 \"" << rule << "\"");
+        continue;
+      }
+      add(static_cast<uint32_t>(first), static_cast<uint32_t>(last));
+      continue;
+    }
+
+    // 否则按 role 配置中的线程名称查找，同名的线程全部加入
+    bool found = false;
+    for (const auto &entry : thread_names) {
+      if (entry.second == rule) {
+        add(entry.first, entry.first);
+        found = true;
+      }
+    }
+    if (!found) {
+      LOG_WARN("警告：thread_filter 规则 \"" << rule
+               << "\" 既不是线程ID也不是 role 配置中的线程名称，已忽略");
+    }
+  }
+
+  std::sort(sparse_.begin(), sparse_.end());
+  std::vector<std::pair<uint32_t, uint32_t>> merged;
+  for (const auto &interval : sparse_) {
+    if (!merged.empty() && interval.first <= merged.back().second) {
+      merged.back().second = std::max(merged.back().second, interval.second);
+    } else {
+      merged.push_back(interval);
+    }
+  }
+  sparse_.swap(merged);
+}
+
+void ThreadFilter::add(uint32_t first, uint32_t last) {
+  if (first < kDenseLimit) {
+    uint32_t dense_last = std::min(last, kDenseLimit - 1);
+    if ((dense_last >> 6) >= bits_.size()) {
+      bits_.resize((dense_last >> 6) + 1, 0);
+    }
+    for (uint32_t id = first; id <= dense_last; id++) {
+      bits_[id >> 6] |= uint64_t(1) << (id & 63);
+    }
+  }
+  if (last >= kDenseLimit) {
+    sparse_.emplace_back(std::max(first, kDenseLimit), last);
+  }
+}
+
+bool ThreadFilter::passSparse(uint32_t thread_id) const {
+  auto it = std::upper_bound(
+      sparse_.begin(), sparse_.end(), thread_id,
+      [](uint32_t t, const std::pair<uint32_t, uint32_t> &interval) {
+        return t < interval.first;
+      });
+  return it != sparse_.begin() && std::prev(it)->second >= thread_id;
+}
+
+void MetadataKeyFilter::compile(const std::vector<std::string> &keep_keys,
+                                const std::vector<std::string> &drop_keys) {
+  keys_.reset();
+  keep_listed_ = !keep_keys.empty();
+  length_mask_ = 0;
+  if (keep_keys.empty() && drop_keys.empty()) {
+    return;
+  }
+
+  auto keys = std::make_shared<StringInterner>();
+  for (const auto &key : keep_listed_ ? keep_keys : drop_keys) {
+    if (keep_listed_ && std::find(drop_keys.begin(), drop_keys.end(), key) != drop_keys.end()) {
+      continue;
+    }
+    keys->intern(key);
+    length_mask_ |= uint64_t(1) << (key.size() < 63 ? key.size() : 63);
+  }
+  keys_ = std::move(keys);
+}